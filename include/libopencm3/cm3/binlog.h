@@ -0,0 +1,76 @@
+/** @defgroup CM3_binlog_defines Binary logging
+ *
+ * @ingroup CM3_defines
+ *
+ * @brief <b>Deferred formatting binary log</b>
+ *
+ * BINLOG() does not format anything on the target. Its format string goes
+ * into the .binlog section, which the linker script keeps in the ELF file
+ * but not in the image, and only the offset of the string there and the
+ * raw arguments are sent. scripts/binlog_decode looks the strings up in the
+ * ELF file and does the formatting on the host.
+ *
+ * Arguments are sent as 32 bit words, so only integer and character
+ * conversions are meaningful; pointers must be cast to uint32_t, and %s
+ * prints the address of the string. Each message is passed to the output
+ * function in one call, e.g. itm_log_write(), which keeps messages whole.
+ *
+ * A message is the string offset, the argument count and the arguments,
+ * each unsigned LEB128 encoded, except for the count, which is one byte.
+ *
+ * @code
+ * binlog_set_output(itm_log_write);
+ * BINLOG("ep %d stalled, status %08x", ep, status);
+ * @endcode
+ *
+ * LGPL License Terms @ref lgpl_license
+ */
+
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBOPENCM3_CM3_BINLOG_H
+#define LIBOPENCM3_CM3_BINLOG_H
+
+#include <libopencm3/cm3/common.h>
+
+/**@{*/
+
+/** Most arguments a message may have */
+#define BINLOG_MAX_ARGS		8
+
+/** Log a message, formatted by the host with printf() conversions */
+#define BINLOG(fmt, ...)						\
+	do {								\
+		static const char __binlog_fmt[]			\
+			__attribute__((section(".binlog"), used)) = fmt; \
+		const uint32_t __binlog_args[] = { 0, ##__VA_ARGS__ };	\
+		binlog_write((uint32_t)__binlog_fmt, __binlog_args + 1,	\
+			     sizeof(__binlog_args) / 4 - 1);		\
+	} while (0)
+
+BEGIN_DECLS
+
+void binlog_set_output(uint32_t (*output)(const void *data, uint32_t len));
+void binlog_write(uint32_t id, const uint32_t *args, uint32_t nargs);
+uint32_t binlog_dropped(void);
+
+END_DECLS
+
+/**@}*/
+
+#endif
@@ -45,6 +45,28 @@
 #	define LIBOPENCM3_DEPRECATED(x)
 #endif
 
+/*
+ * Placement of code and data outside the default sections. reset_handler
+ * copies RAMFUNC code along with .data. The CCM and RAMn sections are only
+ * set up by the linker script generated from ld/linker.ld.S, for parts that
+ * have those memories: *DATA is copied from flash, *BSS is zeroed, and
+ * CCMRAM is left uninitialized as before. NOINIT data keeps its contents
+ * across resets.
+ *
+ * RAMFUNC functions are called with long calls, as RAM may be out of branch
+ * range from flash.
+ */
+#define RAMFUNC		__attribute__((section(".ramfunc"), noinline, \
+				       long_call))
+#define NOINIT		__attribute__((section(".noinit")))
+#define CCMRAM		__attribute__((section(".ccmram")))
+#define CCMDATA		__attribute__((section(".ccmdata")))
+#define CCMBSS		__attribute__((section(".ccmbss")))
+#define RAM1DATA	__attribute__((section(".ram1data")))
+#define RAM1BSS		__attribute__((section(".ram1bss")))
+#define RAM2DATA	__attribute__((section(".ram2data")))
+#define RAM2BSS		__attribute__((section(".ram2bss")))
+
 
 /* Generic memory-mapped I/O accessor functions */
 #define MMIO8(addr)		(*(volatile uint8_t *)(addr))
@@ -145,6 +145,7 @@
 BEGIN_DECLS
 
 bool dwt_enable_cycle_counter(void);
+bool dwt_ensure_cycle_counter(void);
 uint32_t dwt_read_cycle_counter(void);
 
 END_DECLS
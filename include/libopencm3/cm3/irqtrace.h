@@ -0,0 +1,70 @@
+/** @defgroup CM3_irqtrace_defines Interrupt tracing
+ *
+ * @ingroup CM3_defines
+ *
+ * @brief <b>Interrupt duration and nesting statistics</b>
+ *
+ * When the library is built with 'make IRQ_TRACE=1', which defines
+ * LIBOPENCM3_IRQ_TRACE, the vector table generated by irq2nvic_h points at
+ * wrappers that call irqtrace_enter() and irqtrace_exit() around every user
+ * interrupt handler. Otherwise the handlers are called directly and none of
+ * this is linked in.
+ *
+ * Per interrupt, the number of runs, and the total and longest time spent in
+ * the handler are kept. Time spent in handlers that preempted it is not
+ * counted, it goes to those. Also kept is the deepest nesting of traced
+ * handlers the interrupt ran at. Time is taken from the DWT cycle counter,
+ * so on ARMv6-M only the counts and nesting are available.
+ *
+ * LGPL License Terms @ref lgpl_license
+ */
+
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBOPENCM3_CM3_IRQTRACE_H
+#define LIBOPENCM3_CM3_IRQTRACE_H
+
+#include <libopencm3/cm3/common.h>
+
+/**@{*/
+
+/** Deepest nesting of traced handlers that is timed */
+#define IRQTRACE_MAX_DEPTH	16
+
+/** Statistics of one interrupt */
+struct irqtrace_stats {
+	uint32_t count;			/**< Completed runs */
+	uint32_t max;			/**< Longest run in cycles */
+	uint64_t total;			/**< Cycles of all runs */
+	uint8_t max_depth;		/**< Deepest nesting, 1 if never nested */
+};
+
+BEGIN_DECLS
+
+bool irqtrace_init(void);
+void irqtrace_enter(void);
+void irqtrace_exit(uint32_t irq);
+const struct irqtrace_stats *irqtrace_get(uint32_t irq);
+uint8_t irqtrace_get_max_depth(void);
+void irqtrace_reset(void);
+
+END_DECLS
+
+/**@}*/
+
+#endif
@@ -27,6 +27,9 @@
 #error "Instrumentation Trace Macrocell not available in CM0"
 #endif
 
+#include <libopencm3/cm3/common.h>
+#include <libopencm3/cm3/memorymap.h>
+
 /* --- ITM registers ------------------------------------------------------- */
 
 /* Stimulus Port x (ITM_STIM<sz>(x)) */
@@ -85,4 +88,22 @@
 #define ITM_TCR_TSENA			(1 << 1)
 #define ITM_TCR_ITMENA			(1 << 0)
 
+/* --- ITM_LAR values ------------------------------------------------------ */
+
+#define ITM_LAR_KEY			0xC5ACCE55
+
+/* --- Function prototypes ------------------------------------------------- */
+
+BEGIN_DECLS
+
+void itm_enable(uint32_t ports, uint8_t trace_bus_id);
+
+void itm_log_init(uint8_t port, uint8_t *buf, uint32_t size);
+uint32_t itm_log_write(const void *data, uint32_t len);
+uint32_t itm_log_puts(const char *s);
+void itm_log_flush(void);
+uint32_t itm_log_dropped(void);
+
+END_DECLS
+
 #endif
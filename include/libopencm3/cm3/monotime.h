@@ -0,0 +1,117 @@
+/** @defgroup CM3_monotime_defines Monotonic clock
+ *
+ * @ingroup CM3_defines
+ *
+ * @brief <b>64 bit monotonic high resolution clock</b>
+ *
+ * Extends the 32 bit DWT cycle counter to 64 bits, so timestamps never wrap
+ * and can be compared and subtracted directly. Where the cycle counter is
+ * missing, as on ARMv6-M, the clock counts SysTick input clocks instead,
+ * made up of the SysTick periods elapsed and the current counter value.
+ *
+ * The application calls monotime_tick() from its sys_tick_handler(). On the
+ * DWT path, this only makes sure the cycle counter is sampled at least once
+ * per wrap; the SysTick path needs it to count periods, and can not be
+ * combined with swtimer_idle(), which changes the period.
+ *
+ * Conversions to and from time units multiply with 32.32 fixed point factors
+ * computed once by monotime_init(), so no division is done on the fast path.
+ *
+ * LGPL License Terms @ref lgpl_license
+ */
+
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBOPENCM3_CM3_MONOTIME_H
+#define LIBOPENCM3_CM3_MONOTIME_H
+
+#include <libopencm3/cm3/common.h>
+
+/**@{*/
+
+/** Conversion factors, 32.32 fixed point, set by monotime_init() */
+struct monotime_factors {
+	uint64_t ns_per_count;
+	uint64_t us_per_count;
+	uint64_t count_per_ns;
+	uint64_t count_per_us;
+};
+
+extern struct monotime_factors monotime_scale;
+
+/*
+ * Multiply v by a 32.32 fixed point factor, keeping the integer part. Built
+ * from 32x32 bit multiplies, so ARMv7-M does it with UMULL alone.
+ */
+static inline uint64_t monotime_mul(uint64_t v, uint64_t f)
+{
+	uint32_t vl = v, vh = v >> 32;
+	uint32_t fl = f, fh = f >> 32;
+	uint64_t mid = (uint64_t)vl * fh + (((uint64_t)vl * fl) >> 32);
+
+	return ((uint64_t)vh * fh << 32) + (uint64_t)vh * fl + mid;
+}
+
+/** Convert a count of the clock to nanoseconds */
+static inline uint64_t monotime_to_ns(uint64_t count)
+{
+	return monotime_mul(count, monotime_scale.ns_per_count);
+}
+
+/** Convert a count of the clock to microseconds */
+static inline uint64_t monotime_to_us(uint64_t count)
+{
+	return monotime_mul(count, monotime_scale.us_per_count);
+}
+
+/** Convert nanoseconds to a count of the clock */
+static inline uint64_t monotime_from_ns(uint64_t ns)
+{
+	return monotime_mul(ns, monotime_scale.count_per_ns);
+}
+
+/** Convert microseconds to a count of the clock */
+static inline uint64_t monotime_from_us(uint64_t us)
+{
+	return monotime_mul(us, monotime_scale.count_per_us);
+}
+
+BEGIN_DECLS
+
+uint32_t monotime_init(uint32_t ahb);
+uint64_t monotime_read(void);
+void monotime_tick(void);
+uint32_t monotime_get_frequency(void);
+
+END_DECLS
+
+/** Current time in nanoseconds */
+static inline uint64_t monotime_ns(void)
+{
+	return monotime_to_ns(monotime_read());
+}
+
+/** Current time in microseconds */
+static inline uint64_t monotime_us(void)
+{
+	return monotime_to_us(monotime_read());
+}
+
+/**@}*/
+
+#endif
@@ -0,0 +1,105 @@
+/** @defgroup CM3_profile_defines Profiling
+ *
+ * @ingroup CM3_defines
+ *
+ * @brief <b>Cycle accurate code profiling with the DWT counters</b>
+ *
+ * A probe measures the code between profile_begin() and profile_end() and
+ * keeps the number of runs and the minimum, maximum and total cycles, with
+ * the cost of the probe itself taken off. Along with the cycles it sums up
+ * the DWT event counters, which tell how many of those cycles were lost to
+ * multi-cycle instructions and stalls (CPI), exception entry and exit,
+ * sleeping, and load/store, and how many instructions were folded.
+ *
+ * The event counters are only 8 bits wide, so their sums are exact only for
+ * runs of less than 256 counts of each. Probes may nest, but a probe must
+ * not be begun again before it has ended, e.g. from an interrupt handler.
+ * Only available on ARMv7-M.
+ *
+ * @code
+ * static struct profile_probe poll_probe = PROFILE_PROBE_INIT("usbd_poll");
+ *
+ * profile_begin(&poll_probe);
+ * usbd_poll(usbd_dev);
+ * profile_end(&poll_probe);
+ * ...
+ * profile_dump(print_line);
+ * @endcode
+ *
+ * LGPL License Terms @ref lgpl_license
+ */
+
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBOPENCM3_CM3_PROFILE_H
+#define LIBOPENCM3_CM3_PROFILE_H
+
+#include <libopencm3/cm3/common.h>
+
+/**@{*/
+
+/* Those are defined only on CM3 or CM4 */
+#if defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__)
+
+/** Indices into the event counter sums of a probe */
+enum profile_event {
+	PROFILE_EVENT_CPI,
+	PROFILE_EVENT_EXC,
+	PROFILE_EVENT_SLEEP,
+	PROFILE_EVENT_LSU,
+	PROFILE_EVENT_FOLD,
+	PROFILE_EVENT_COUNT,
+};
+
+/** Profiling probe, allocated by the application */
+struct profile_probe {
+	const char *name;
+	uint32_t count;			/**< Completed runs */
+	uint32_t min;			/**< Fewest cycles of a run */
+	uint32_t max;			/**< Most cycles of a run */
+	uint64_t total;			/**< Cycles of all runs */
+	uint32_t events[PROFILE_EVENT_COUNT];	/**< Event counts of all runs */
+
+	/* Private, counter values at profile_begin() */
+	uint32_t start_cycles;
+	uint8_t start_events[PROFILE_EVENT_COUNT];
+	bool listed;
+	struct profile_probe *next;
+};
+
+/** Static initializer for a probe */
+#define PROFILE_PROBE_INIT(probe_name)	{ .name = (probe_name), \
+					  .min = 0xffffffff }
+
+BEGIN_DECLS
+
+bool profile_init(void);
+void profile_begin(struct profile_probe *p);
+void profile_end(struct profile_probe *p);
+uint32_t profile_mean(const struct profile_probe *p);
+void profile_reset(struct profile_probe *p);
+void profile_reset_all(void);
+void profile_dump(void (*print)(const char *line));
+
+END_DECLS
+
+#endif
+
+/**@}*/
+
+#endif
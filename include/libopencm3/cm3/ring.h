@@ -0,0 +1,100 @@
+/** @defgroup CM3_ring_defines Lock-free ring buffers
+ *
+ * @ingroup CM3_defines
+ *
+ * @brief <b>Lock-free ring buffers for passing data between contexts</b>
+ *
+ * A @ref ring_spsc moves bytes from exactly one producer to exactly one
+ * consumer, e.g. from a receive interrupt to the main loop. Each side only
+ * writes its own index, so no locking is needed on any core.
+ *
+ * A @ref ring_mpmc moves 32 bit words (values or pointers) between any
+ * number of producers and consumers. Slots are claimed with exclusive
+ * accesses on ARMv7-M, and with interrupts briefly masked on ARMv6-M, which
+ * has no exclusive access instructions.
+ *
+ * The size of both rings must be a power of two.
+ *
+ * LGPL License Terms @ref lgpl_license
+ */
+
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBOPENCM3_CM3_RING_H
+#define LIBOPENCM3_CM3_RING_H
+
+#include <libopencm3/cm3/common.h>
+
+/**@{*/
+
+/** Single producer, single consumer byte ring */
+struct ring_spsc {
+	uint8_t *buf;
+	uint32_t mask;
+	volatile uint32_t head;		/**< Written by the producer only */
+	volatile uint32_t tail;		/**< Written by the consumer only */
+};
+
+/** Slot of a @ref ring_mpmc */
+struct ring_mpmc_slot {
+	volatile uint32_t seq;
+	uint32_t data;
+};
+
+/** Multi producer, multi consumer word queue */
+struct ring_mpmc {
+	struct ring_mpmc_slot *slots;
+	uint32_t mask;
+	volatile uint32_t head;		/**< Next slot to push to */
+	volatile uint32_t tail;		/**< Next slot to pop from */
+};
+
+/** Bytes waiting in a @ref ring_spsc */
+static inline uint32_t ring_spsc_used(const struct ring_spsc *ring)
+{
+	return ring->head - ring->tail;
+}
+
+/** Room left in a @ref ring_spsc */
+static inline uint32_t ring_spsc_free(const struct ring_spsc *ring)
+{
+	return ring->mask + 1 - (ring->head - ring->tail);
+}
+
+BEGIN_DECLS
+
+void ring_spsc_init(struct ring_spsc *ring, uint8_t *buf, uint32_t size);
+uint32_t ring_spsc_write(struct ring_spsc *ring, const uint8_t *data,
+			 uint32_t len);
+uint32_t ring_spsc_read(struct ring_spsc *ring, uint8_t *data, uint32_t len);
+uint32_t ring_spsc_peek(const struct ring_spsc *ring, uint8_t *data,
+			uint32_t len);
+void ring_spsc_skip(struct ring_spsc *ring, uint32_t len);
+bool ring_spsc_put(struct ring_spsc *ring, uint8_t c);
+bool ring_spsc_get(struct ring_spsc *ring, uint8_t *c);
+
+void ring_mpmc_init(struct ring_mpmc *ring, struct ring_mpmc_slot *slots,
+		    uint32_t size);
+bool ring_mpmc_push(struct ring_mpmc *ring, uint32_t val);
+bool ring_mpmc_pop(struct ring_mpmc *ring, uint32_t *val);
+
+END_DECLS
+
+/**@}*/
+
+#endif
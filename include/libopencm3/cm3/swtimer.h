@@ -0,0 +1,74 @@
+/** @defgroup CM3_swtimer_defines Software timers
+ *
+ * @ingroup CM3_defines
+ *
+ * @brief <b>Software timers driven by SysTick</b>
+ *
+ * One-shot and periodic timers are kept on a hashed timing wheel of
+ * @ref SWTIMER_WHEEL_SIZE slots, so starting, stopping and expiring a timer
+ * takes constant time. Callbacks run from swtimer_tick(), which the
+ * application calls from its sys_tick_handler().
+ *
+ * In tickless idle, swtimer_idle() stretches the SysTick period up to the
+ * next deadline before sleeping, so the core is not woken on every tick
+ * while nothing is due.
+ *
+ * LGPL License Terms @ref lgpl_license
+ */
+
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBOPENCM3_CM3_SWTIMER_H
+#define LIBOPENCM3_CM3_SWTIMER_H
+
+#include <libopencm3/cm3/common.h>
+
+/**@{*/
+
+/** Number of wheel slots, a power of two */
+#ifndef SWTIMER_WHEEL_SIZE
+#define SWTIMER_WHEEL_SIZE	32
+#endif
+
+/** Software timer, allocated by the application */
+struct swtimer {
+	uint32_t expires;		/**< Tick of the next expiry */
+	uint32_t period;		/**< Reload in ticks, 0 for one-shot */
+	void (*callback)(void *arg);
+	void *arg;
+	struct swtimer *next;
+	struct swtimer *prev;
+	bool active;
+};
+
+BEGIN_DECLS
+
+void swtimer_init(void);
+void swtimer_start(struct swtimer *t, uint32_t ticks, uint32_t period,
+		   void (*callback)(void *arg), void *arg);
+void swtimer_stop(struct swtimer *t);
+bool swtimer_is_active(const struct swtimer *t);
+void swtimer_tick(void);
+uint32_t swtimer_get_ticks(void);
+void swtimer_idle(void);
+
+END_DECLS
+
+/**@}*/
+
+#endif
@@ -22,7 +22,59 @@
 
 #include "common.h"
 
-void __dmb(void);
+/*
+ * Builds for the build host, such as the programs in tests/host, get the
+ * closest host equivalents: full barriers, atomics from the compiler and
+ * critical sections that do nothing, as there are no interrupts to mask.
+ */
+#if defined(__arm__)
+
+/* DMB is supported on CM0 */
+static inline void __dmb(void)
+{
+	__asm__ volatile ("dmb" : : : "memory");
+}
+
+static inline void __dsb(void)
+{
+	__asm__ volatile ("dsb" : : : "memory");
+}
+
+/* Sleep until an event, interrupt or SEV; returns at once if one is latched */
+static inline void __wfe(void)
+{
+	__asm__ volatile ("wfe" : : : "memory");
+}
+
+/* Signal an event to all cores, waking them from WFE */
+static inline void __sev(void)
+{
+	__asm__ volatile ("sev" : : : "memory");
+}
+
+#else
+
+static inline void __dmb(void)
+{
+	__sync_synchronize();
+}
+
+static inline void __dsb(void)
+{
+	__sync_synchronize();
+}
+
+static inline void __wfe(void)
+{
+	__asm__ volatile ("" : : : "memory");
+}
+
+static inline void __sev(void)
+{
+	__asm__ volatile ("" : : : "memory");
+}
+
+#endif
 
 /* Implements synchronisation primitives as discussed in the ARM document
  * DHT0008A (ID081709) "ARM Synchronization Primitives" and the ARM v7-M
@@ -34,22 +86,235 @@ void __dmb(void);
 /* Those are defined only on CM3 or CM4 */
 #if defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__)
 
-uint32_t __ldrex(volatile uint32_t *addr);
-uint32_t __strex(uint32_t val, volatile uint32_t *addr);
+static inline uint32_t __ldrex(volatile uint32_t *addr)
+{
+	uint32_t res;
+	__asm__ volatile ("ldrex %0, [%1]" : "=r" (res) : "r" (addr));
+	return res;
+}
+
+static inline uint32_t __strex(uint32_t val, volatile uint32_t *addr)
+{
+	uint32_t res;
+	__asm__ volatile ("strex %0, %2, [%1]"
+			  : "=&r" (res) : "r" (addr), "r" (val) : "memory");
+	return res;
+}
+
+static inline void __clrex(void)
+{
+	__asm__ volatile ("clrex" : : : "memory");
+}
+
+#endif
+
+/* --- Critical sections --------------------------------------------------- */
+
+/*
+ * Mask all interrupts and return the previous mask, to be handed back to
+ * cm_critical_exit(). Sections nest, only the outermost exit unmasks.
+ */
+static inline uint32_t cm_critical_enter(void)
+{
+	uint32_t primask = 0;
+
+#if defined(__arm__)
+	__asm__ volatile ("mrs %0, primask" : "=r" (primask));
+	__asm__ volatile ("cpsid i" : : : "memory");
+#else
+	__asm__ volatile ("" : : : "memory");
+#endif
+	return primask;
+}
+
+static inline void cm_critical_exit(uint32_t primask)
+{
+#if defined(__arm__)
+	__asm__ volatile ("msr primask, %0" : : "r" (primask) : "memory");
+#else
+	(void)primask;
+	__asm__ volatile ("" : : : "memory");
+#endif
+}
+
+#if defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__)
+
+/*
+ * Mask interrupts of priority value prio and above (numerically), leaving
+ * more urgent ones running. The threshold is only ever raised, so calls
+ * nest; hand the returned value to cm_basepri_restore() when done. prio is
+ * the raw 8 bit priority as written to NVIC_IPR, 0 does not mask anything.
+ */
+static inline uint32_t cm_basepri_raise(uint8_t prio)
+{
+	uint32_t basepri;
+
+	__asm__ volatile ("mrs %0, basepri" : "=r" (basepri));
+	__asm__ volatile ("msr basepri_max, %0" : : "r" ((uint32_t)prio)
+			  : "memory");
+	return basepri;
+}
+
+static inline void cm_basepri_restore(uint32_t basepri)
+{
+	__asm__ volatile ("msr basepri, %0" : : "r" (basepri) : "memory");
+}
+
+#endif
+
+/* --- Atomic operations --------------------------------------------------- */
+
+/*
+ * Read-modify-write operations on a 32 bit word, atomic against interrupts
+ * and, on ARMv7-M, against other bus masters using exclusive accesses.
+ * They do not imply a memory barrier, add __dmb() where ordering matters.
+ */
+
+#if defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__)
+
+#define __CM_ATOMIC_OP(name, expr)					\
+static inline uint32_t cm_atomic_##name(volatile uint32_t *addr,	\
+					uint32_t val)			\
+{									\
+	uint32_t old;							\
+									\
+	do {								\
+		old = __ldrex(addr);					\
+	} while (__strex(expr, addr));					\
+									\
+	return old;							\
+}
+
+#elif !defined(__arm__)
+
+#define __CM_ATOMIC_OP(name, expr)					\
+static inline uint32_t cm_atomic_##name(volatile uint32_t *addr,	\
+					uint32_t val)			\
+{									\
+	uint32_t old = *addr;						\
+									\
+	while (!__atomic_compare_exchange_n(addr, &old, expr, false,	\
+					    __ATOMIC_SEQ_CST,		\
+					    __ATOMIC_SEQ_CST)) {	\
+	}								\
+									\
+	return old;							\
+}
+
+#else
+
+#define __CM_ATOMIC_OP(name, expr)					\
+static inline uint32_t cm_atomic_##name(volatile uint32_t *addr,	\
+					uint32_t val)			\
+{									\
+	uint32_t old;							\
+	uint32_t primask = cm_critical_enter();				\
+									\
+	old = *addr;							\
+	*addr = expr;							\
+	cm_critical_exit(primask);					\
+									\
+	return old;							\
+}
+
+#endif
+
+/* Each returns the value *addr held before the operation. */
+__CM_ATOMIC_OP(fetch_add, old + val)
+__CM_ATOMIC_OP(fetch_sub, old - val)
+__CM_ATOMIC_OP(fetch_or, old | val)
+__CM_ATOMIC_OP(fetch_and, old & val)
+__CM_ATOMIC_OP(xchg, val)
+
+#undef __CM_ATOMIC_OP
+
+/* Set *addr to desired if it holds expected. Returns true if it did. */
+static inline bool cm_atomic_cas(volatile uint32_t *addr, uint32_t expected,
+				 uint32_t desired)
+{
+#if defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__)
+	do {
+		if (__ldrex(addr) != expected) {
+			__clrex();
+			return false;
+		}
+	} while (__strex(desired, addr));
+
+	return true;
+#elif !defined(__arm__)
+	return __atomic_compare_exchange_n(addr, &expected, desired, false,
+					   __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+#else
+	bool ok = false;
+	uint32_t primask = cm_critical_enter();
+
+	if (*addr == expected) {
+		*addr = desired;
+		ok = true;
+	}
+	cm_critical_exit(primask);
+
+	return ok;
+#endif
+}
+
+static inline void cm_atomic_set_bits(volatile uint32_t *addr, uint32_t bits)
+{
+	cm_atomic_fetch_or(addr, bits);
+}
+
+static inline void cm_atomic_clear_bits(volatile uint32_t *addr,
+					uint32_t bits)
+{
+	cm_atomic_fetch_and(addr, ~bits);
+}
 
 /* --- Convenience functions ----------------------------------------------- */
 
-/* Here we implement some simple synchronisation primitives. */
+/*
+ * Here we implement some simple synchronisation primitives. Waiting sleeps
+ * in WFE instead of spinning, and every release or signal issues SEV, so
+ * waiters wake up as soon as there is something to check. The release and
+ * signal functions may be called from interrupt handlers, the waiting ones
+ * must not be called from a handler the signal would come from.
+ */
+
+/* Those are defined only on CM3 or CM4 */
+#if defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__)
 
 typedef uint32_t mutex_t;
 
 #define MUTEX_UNLOCKED 0
 #define MUTEX_LOCKED	 1
 
+BEGIN_DECLS
+
 void mutex_lock(mutex_t *m);
 uint32_t mutex_trylock(mutex_t *m);
 void mutex_unlock(mutex_t *m);
 
+END_DECLS
+
 #endif
 
+/* Counting semaphore, holding the number of available units */
+typedef uint32_t semaphore_t;
+
+/* Group of up to 32 event flags */
+typedef uint32_t event_flags_t;
+
+BEGIN_DECLS
+
+void semaphore_init(semaphore_t *s, uint32_t count);
+void semaphore_wait(semaphore_t *s);
+bool semaphore_trywait(semaphore_t *s);
+void semaphore_post(semaphore_t *s);
+
+void event_flags_set(event_flags_t *f, uint32_t flags);
+void event_flags_clear(event_flags_t *f, uint32_t flags);
+uint32_t event_flags_wait_any(event_flags_t *f, uint32_t flags, bool clear);
+uint32_t event_flags_wait_all(event_flags_t *f, uint32_t flags, bool clear);
+
+END_DECLS
+
 #endif
@@ -0,0 +1,87 @@
+/** @defgroup CM3_task_defines Task switcher
+ *
+ * @ingroup CM3_defines
+ *
+ * @brief <b>Minimal preemptive, fixed priority task switcher</b>
+ *
+ * Tasks run in thread mode on their own stack (PSP), interrupt handlers on
+ * the main stack (MSP). The highest priority ready task runs; tasks of equal
+ * priority take turns on every tick and on task_yield(). The switch itself
+ * is done in the PendSV handler, at the lowest exception priority, so it
+ * never delays an interrupt handler. On parts with an FPU, the floating
+ * point registers are only saved for tasks that have used them.
+ *
+ * The application calls task_tick() from its sys_tick_handler() and takes
+ * over the pend_sv_handler() by linking this module. Only available on
+ * ARMv7-M.
+ *
+ * LGPL License Terms @ref lgpl_license
+ */
+
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBOPENCM3_CM3_TASK_H
+#define LIBOPENCM3_CM3_TASK_H
+
+#include <libopencm3/cm3/common.h>
+
+/**@{*/
+
+/* Those are defined only on CM3 or CM4 */
+#if defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__)
+
+/** Task states */
+enum task_state {
+	TASK_READY,
+	TASK_SLEEPING,
+	TASK_SUSPENDED,
+	TASK_DEAD,
+};
+
+/** Task control block, allocated by the application */
+struct task {
+	uint32_t *sp;			/**< Saved stack pointer, must be first */
+	struct task *next;		/**< Next task in creation order */
+	uint32_t wake;			/**< Tick to wake up at when sleeping */
+	uint8_t prio;			/**< Higher values run first */
+	uint8_t state;			/**< enum task_state */
+};
+
+/** Smallest useful stack, in words, including room for the FPU context */
+#define TASK_STACK_MIN		64
+
+BEGIN_DECLS
+
+void task_create(struct task *t, void (*entry)(void *), void *arg,
+		 uint32_t *stack, uint32_t stack_words, uint8_t prio);
+void task_start(void) __attribute__((noreturn));
+void task_yield(void);
+void task_sleep(uint32_t ticks);
+void task_suspend(struct task *t);
+void task_resume(struct task *t);
+void task_tick(void);
+struct task *task_current(void);
+uint32_t task_get_ticks(void);
+
+END_DECLS
+
+#endif
+
+/**@}*/
+
+#endif
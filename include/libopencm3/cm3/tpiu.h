@@ -27,6 +27,9 @@
 #error "Trace Port Interface Unit not available in CM0"
 #endif
 
+#include <libopencm3/cm3/common.h>
+#include <libopencm3/cm3/memorymap.h>
+
 /* --- TPIU registers ------------------------------------------------------ */
 
 /* Supported Synchronous Port Size (TPIU_SSPSR) */
@@ -94,4 +97,12 @@
 #define TPUI_DEVID_FIFO_SIZE_MASK	(7 << 6)
 /* Bits 5:0 - Implementation defined */
 
+/* --- Function prototypes ------------------------------------------------- */
+
+BEGIN_DECLS
+
+uint32_t tpiu_swo_setup(uint32_t traceclk, uint32_t baud, uint32_t protocol);
+
+END_DECLS
+
 #endif
@@ -61,4 +61,22 @@ typedef struct {
 	vector_table_entry_t irq[NVIC_IRQ_COUNT];
 } vector_table_t;
 
+/** Number of entries of a vector table, including the initial stack pointer */
+#define VECTOR_TABLE_ENTRIES	(16 + NVIC_IRQ_COUNT)
+
+/** Alignment SCB_VTOR needs: the table size rounded up to a power of two,
+ * and at least 128 bytes. */
+#define VECTOR_TABLE_ALIGN \
+	(sizeof(vector_table_t) <= 128 ? 128 : \
+	 sizeof(vector_table_t) <= 256 ? 256 : \
+	 sizeof(vector_table_t) <= 512 ? 512 : 1024)
+
+BEGIN_DECLS
+
+bool vector_table_relocate(void);
+vector_table_entry_t vector_set_handler(int irqn,
+					vector_table_entry_t handler);
+
+END_DECLS
+
 #endif
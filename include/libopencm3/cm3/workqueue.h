@@ -0,0 +1,78 @@
+/** @defgroup CM3_workqueue_defines Deferred work
+ *
+ * @ingroup CM3_defines
+ *
+ * @brief <b>Deferred work run from PendSV</b>
+ *
+ * Interrupt handlers hand the part of their work that is not urgent to
+ * workqueue_post(), which queues it lock-free and pends PendSV. The PendSV
+ * handler, at the lowest priority, runs the queued work in the order it was
+ * posted, once no other handler is active.
+ *
+ * The default PendSV handler and the one of the task switcher run the queue
+ * when this module is linked in. An application defining its own
+ * pend_sv_handler() calls workqueue_run() from it.
+ *
+ * @code
+ * static struct ring_mpmc_slot slots[16];
+ * static struct work rx_work = WORK_INIT(rx_process, NULL);
+ *
+ * workqueue_init(slots, 16);
+ * ...
+ * void usart1_isr(void)
+ * {
+ *	...
+ *	workqueue_post(&rx_work);
+ * }
+ * @endcode
+ *
+ * LGPL License Terms @ref lgpl_license
+ */
+
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBOPENCM3_CM3_WORKQUEUE_H
+#define LIBOPENCM3_CM3_WORKQUEUE_H
+
+#include <libopencm3/cm3/common.h>
+#include <libopencm3/cm3/ring.h>
+
+/**@{*/
+
+/** Work item, allocated by the application */
+struct work {
+	void (*func)(void *arg);
+	void *arg;
+	volatile uint32_t pending;	/**< Queued and not yet started */
+};
+
+/** Static initializer for a work item */
+#define WORK_INIT(work_func, work_arg)	{ .func = (work_func), \
+					  .arg = (work_arg) }
+
+BEGIN_DECLS
+
+void workqueue_init(struct ring_mpmc_slot *slots, uint32_t size);
+bool workqueue_post(struct work *w);
+void workqueue_run(void);
+
+END_DECLS
+
+/**@}*/
+
+#endif
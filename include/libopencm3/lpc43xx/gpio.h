@@ -771,6 +771,32 @@ LGPL License Terms @ref lgpl_license
 
 /* TODO interrupts */
 
+/*
+ * Inline versions of gpio_set(), gpio_clear() and gpio_toggle(), for
+ * bit-banged protocols and other code where the call overhead matters.
+ * Each is a single write to the SET, CLR or NOT register, and so atomic.
+ */
+
+static inline void gpio_fast_set(uint32_t gpioport, uint32_t gpios)
+{
+	GPIO_SET(gpioport) = gpios;
+}
+
+static inline void gpio_fast_clear(uint32_t gpioport, uint32_t gpios)
+{
+	GPIO_CLR(gpioport) = gpios;
+}
+
+static inline uint32_t gpio_fast_get(uint32_t gpioport, uint32_t gpios)
+{
+	return GPIO_PIN(gpioport) & gpios;
+}
+
+static inline void gpio_fast_toggle(uint32_t gpioport, uint32_t gpios)
+{
+	GPIO_NOT(gpioport) = gpios;
+}
+
 BEGIN_DECLS
 
 void gpio_set(uint32_t gpioport, uint32_t gpios);
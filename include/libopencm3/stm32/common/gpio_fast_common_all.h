@@ -0,0 +1,93 @@
+/** @addtogroup gpio_defines
+ */
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* THIS FILE SHOULD NOT BE INCLUDED DIRECTLY, BUT ONLY VIA GPIO.H
+The order of header inclusion is important. It is included at the end of the
+family gpio.h, as the functions below need the register definitions.*/
+
+/** @cond */
+#if defined(LIBOPENCM3_GPIO_H)
+/** @endcond */
+#ifndef LIBOPENCM3_GPIO_FAST_COMMON_ALL_H
+#define LIBOPENCM3_GPIO_FAST_COMMON_ALL_H
+
+/**@{*/
+
+/*
+ * Inline versions of gpio_set(), gpio_clear(), gpio_get() and
+ * gpio_toggle(), for bit-banged protocols and other code where the call
+ * overhead matters. With constant arguments each compiles to one or two
+ * register accesses.
+ */
+
+static inline void gpio_fast_set(uint32_t gpioport, uint16_t gpios)
+{
+	GPIO_BSRR(gpioport) = gpios;
+}
+
+static inline void gpio_fast_clear(uint32_t gpioport, uint16_t gpios)
+{
+	GPIO_BSRR(gpioport) = (uint32_t)gpios << 16;
+}
+
+static inline uint16_t gpio_fast_get(uint32_t gpioport, uint16_t gpios)
+{
+	return GPIO_IDR(gpioport) & gpios;
+}
+
+/*
+ * A single BSRR write sets the pins that were low and resets those that
+ * were high, so other pins of the port may be changed concurrently. Only
+ * a concurrent change of the toggled pins themselves can be lost.
+ */
+static inline void gpio_fast_toggle(uint32_t gpioport, uint16_t gpios)
+{
+	uint32_t port = GPIO_ODR(gpioport);
+
+	GPIO_BSRR(gpioport) = ((port & gpios) << 16) | (~port & gpios);
+}
+
+/* Bit-banding exists on ARMv7-M, for peripherals below 0x40100000 only */
+#if (defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__)) && \
+    (GPIO_PORT_A_BASE < 0x40100000U)
+
+/*
+ * Access to a single pin through its bit-band alias. Unlike the functions
+ * above, these take a pin number 0..15 rather than a pin mask.
+ */
+
+static inline void gpio_bb_write(uint32_t gpioport, uint8_t pin, bool value)
+{
+	BBIO_PERIPH(&GPIO_ODR(gpioport), pin) = value;
+}
+
+static inline bool gpio_bb_read(uint32_t gpioport, uint8_t pin)
+{
+	return BBIO_PERIPH(&GPIO_IDR(gpioport), pin);
+}
+
+#endif
+
+/**@}*/
+#endif
+/** @cond */
+#else
+#warning "gpio_fast_common_all.h should not be included explicitly, only via gpio.h"
+#endif
+/** @endcond */
@@ -974,6 +974,8 @@ void gpio_secondary_remap(uint32_t maps);
 
 END_DECLS
 
+#include <libopencm3/stm32/common/gpio_fast_common_all.h>
+
 #endif
 /**@}*/
 
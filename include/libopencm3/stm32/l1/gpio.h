@@ -258,6 +258,8 @@ void gpio_set_af(uint32_t gpioport, uint8_t alt_func_num, uint16_t gpios);
 
 END_DECLS
 
+#include <libopencm3/stm32/common/gpio_fast_common_all.h>
+
 #endif
 /**@}*/
 
@@ -293,6 +293,7 @@
 #define OTG_FS_DIEPCTL0_MPSIZ_32	(0x1 << 0)
 #define OTG_FS_DIEPCTL0_MPSIZ_16	(0x2 << 0)
 #define OTG_FS_DIEPCTL0_MPSIZ_8		(0x3 << 0)
+#define OTG_FS_DIEPCTLX_MPSIZ_MASK	(0x7ff << 0)
 
 /* OTG_FS Device Control OUT Endpoint 0 Control Register (OTG_FS_DOEPCTL0) */
 #define OTG_FS_DOEPCTL0_EPENA		(1 << 31)
@@ -347,4 +348,13 @@
 /* Bits 18:7 - Reserved */
 #define OTG_FS_DIEPSIZ0_XFRSIZ_MASK	(0x7f << 0)
 
+/* OTG_FS Device IN Endpoint x Transfer Size Register (OTG_FS_DIEPTSIZx) */
+#define OTG_FS_DIEPSIZX_MCNT_MASK	(0x3 << 29)
+#define OTG_FS_DIEPSIZX_PKTCNT_SHIFT	19
+#define OTG_FS_DIEPSIZX_PKTCNT_MASK	(0x3ff << 19)
+#define OTG_FS_DIEPSIZX_XFRSIZ_MASK	(0x7ffff << 0)
+
+/* OTG_FS Device IN Endpoint Transmit FIFO Status Register (OTG_FS_DTXFSTSx) */
+#define OTG_FS_DTXFSTS_INEPTFSAV_MASK	(0xffff << 0)
+
 #endif
@@ -166,6 +166,13 @@ LGPL License Terms @ref lgpl_license
 
 #define USB_EP_ADDR		0x000F /* Endpoint Address */
 
+/*
+ * On double-buffered endpoints the data toggle bit of the unused direction
+ * is the SW_BUF flag, marking the buffer currently owned by the application.
+ */
+#define USB_EP_RX_SW_BUF	USB_EP_TX_DTOG
+#define USB_EP_TX_SW_BUF	USB_EP_RX_DTOG
+
 /* Masking all toggle bits */
 #define USB_EP_NTOGGLE_MSK	(USB_EP_RX_CTR | \
 				 USB_EP_SETUP | \
@@ -264,6 +271,17 @@ LGPL License Terms @ref lgpl_license
 		GET_REG(USB_EP_REG(EP)) & \
 		(USB_EP_NTOGGLE_MSK | USB_EP_RX_DTOG))
 
+/* Macros for toggling DTOG bits, used to flip SW_BUF on double buffering */
+#define USB_TOG_EP_TX_DTOG(EP) \
+	SET_REG(USB_EP_REG(EP), \
+		(GET_REG(USB_EP_REG(EP)) & USB_EP_NTOGGLE_MSK) | \
+		USB_EP_TX_DTOG)
+
+#define USB_TOG_EP_RX_DTOG(EP) \
+	SET_REG(USB_EP_REG(EP), \
+		(GET_REG(USB_EP_REG(EP)) & USB_EP_NTOGGLE_MSK) | \
+		USB_EP_RX_DTOG)
+
 /* --- USB BTABLE registers ------------------------------------------------ */
 
 #define USB_GET_BTABLE		GET_REG(USB_BTABLE_REG)
@@ -297,6 +315,20 @@ LGPL License Terms @ref lgpl_license
 #define USB_GET_EP_RX_BUFF(EP) \
 	(USB_PMA_BASE + (uint8_t *)(USB_GET_EP_RX_ADDR(EP) * 2))
 
+/*
+ * Double-buffered endpoints use both buffer descriptors for the same
+ * direction: buffer 0 is described by the TX slot, buffer 1 by the RX slot.
+ */
+#define USB_GET_EP_DBUF_BUFF(EP, BUF) \
+	((BUF) ? USB_GET_EP_RX_BUFF(EP) : USB_GET_EP_TX_BUFF(EP))
+
+#define USB_GET_EP_DBUF_COUNT(EP, BUF) \
+	((BUF) ? USB_GET_EP_RX_COUNT(EP) : USB_GET_EP_TX_COUNT(EP))
+
+#define USB_SET_EP_DBUF_COUNT(EP, BUF, COUNT) \
+	((BUF) ? USB_SET_EP_RX_COUNT(EP, COUNT) : \
+		 USB_SET_EP_TX_COUNT(EP, COUNT))
+
 #endif
 
 /**@}*/
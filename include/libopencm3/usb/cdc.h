@@ -116,7 +116,7 @@ struct usb_cdc_acm_descriptor {
 /* Table 13: Class-Specific Request Codes for PSTN subclasses */
 /* ... */
 #define USB_CDC_REQ_SET_LINE_CODING		0x20
-/* ... */
+#define USB_CDC_REQ_GET_LINE_CODING		0x21
 #define USB_CDC_REQ_SET_CONTROL_LINE_STATE	0x22
 /* ... */
 
@@ -156,6 +156,21 @@ struct usb_cdc_notification {
 	uint16_t wLength;
 } __attribute__((packed));
 
+/* Buffered CDC-ACM function <usb_cdcacm.c> */
+typedef struct _usbd_cdcacm usbd_cdcacm;
+
+usbd_cdcacm *usb_cdcacm_init(usbd_device *usbd_dev, uint8_t iface,
+			     uint8_t ep_in, uint8_t ep_out, uint8_t ep_size,
+			     uint8_t *tx_buf, uint16_t tx_size,
+			     uint8_t *rx_buf, uint16_t rx_size);
+uint16_t usb_cdcacm_write(usbd_cdcacm *acm, const void *buf, uint16_t len);
+uint16_t usb_cdcacm_read(usbd_cdcacm *acm, void *buf, uint16_t len);
+uint16_t usb_cdcacm_rx_available(usbd_cdcacm *acm);
+uint16_t usb_cdcacm_tx_free(usbd_cdcacm *acm);
+const struct usb_cdc_line_coding *usb_cdcacm_get_line_coding(
+		usbd_cdcacm *acm);
+uint16_t usb_cdcacm_get_line_state(usbd_cdcacm *acm);
+
 #endif
 
 /**@}*/
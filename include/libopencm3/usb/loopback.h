@@ -0,0 +1,89 @@
+/** @defgroup usb_loopback_defines USB Loopback Driver
+
+@brief <b>Memory-backed USB driver and host model</b>
+
+@ingroup USB_defines
+
+LGPL License Terms @ref lgpl_license
+*/
+
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**@{*/
+
+#ifndef __USB_LOOPBACK_H
+#define __USB_LOOPBACK_H
+
+#include <libopencm3/usb/usbd.h>
+
+BEGIN_DECLS
+
+/*
+ * The loopback driver keeps its endpoint buffers in memory instead of a USB
+ * peripheral, so the generic part of lib/usb/ can be built and run on a
+ * host, e.g. with
+ *
+ *   gcc -Iinclude lib/usb/usb.c lib/usb/usb_control.c \
+ *	lib/usb/usb_standard.c lib/usb/usb_transfer.c \
+ *	lib/usb/usb_loopback.c app.c
+ *
+ * adding lib/usb/usb_msc.c for the mass storage function. The application
+ * plays the USB host through the usb_loopback_* functions and drives the
+ * device side with usbd_poll() as usual. It is not part of the target
+ * libraries. tests/host/usb_bench.c measures enumeration, throughput and
+ * callbacks per transfer with it, tests/host/cdcacm_bench.c the CDC-ACM
+ * function frame by frame; both are run by 'make hosttest'.
+ */
+extern const usbd_driver loopback_usb_driver;
+
+/* Handshakes returned by the token functions instead of a byte count */
+#define USB_LOOPBACK_NAK	-1
+#define USB_LOOPBACK_STALL	-2
+
+/* Bytes buffered per endpoint and direction */
+#define USB_LOOPBACK_PACKET_SIZE	64
+
+struct usb_loopback_stats {
+	uint32_t sof;		/* Start of frame packets */
+	uint32_t setup;		/* SETUP tokens accepted */
+	uint32_t in;		/* IN tokens answered with data */
+	uint32_t out;		/* OUT tokens accepted */
+	uint32_t nak;
+	uint32_t stall;
+	uint32_t callbacks;	/* Endpoint callbacks run by usbd_poll() */
+};
+
+void usb_loopback_bus_reset(usbd_device *usbd_dev);
+void usb_loopback_sof(usbd_device *usbd_dev);
+int usb_loopback_setup(usbd_device *usbd_dev,
+		       const struct usb_setup_data *req);
+int usb_loopback_in(usbd_device *usbd_dev, uint8_t ep, void *buf,
+		    uint16_t len);
+int usb_loopback_out(usbd_device *usbd_dev, uint8_t ep, const void *buf,
+		     uint16_t len);
+int usb_loopback_control(usbd_device *usbd_dev,
+			 const struct usb_setup_data *req, void *buf);
+uint8_t usb_loopback_get_address(usbd_device *usbd_dev);
+struct usb_loopback_stats *usb_loopback_get_stats(usbd_device *usbd_dev);
+
+END_DECLS
+
+#endif
+
+/**@}*/
+
@@ -88,6 +88,15 @@ usbd_mass_storage *usb_msc_init(usbd_device *usbd_dev,
 				 int (*read_block)(uint32_t lba, uint8_t *copy_to),
 				 int (*write_block)(uint32_t lba, const uint8_t *copy_from));
 
+void usb_msc_set_async_storage(usbd_mass_storage *ms,
+			       uint8_t *buf, uint8_t num_blocks,
+			       int (*read_blocks)(uint32_t lba, uint8_t *copy_to,
+						  uint32_t count),
+			       int (*write_blocks)(uint32_t lba,
+						   const uint8_t *copy_from,
+						   uint32_t count));
+void usb_msc_storage_complete(usbd_mass_storage *ms, int status);
+
 #endif
 
 /**@}*/
@@ -75,6 +75,11 @@ extern void usbd_register_resume_callback(usbd_device *usbd_dev,
 extern void usbd_register_sof_callback(usbd_device *usbd_dev,
 				       void (*callback)(void));
 
+/* Default number of endpoint events handled per usbd_poll() call */
+#define USBD_POLL_BUDGET_DEFAULT	16
+
+extern void usbd_set_poll_budget(usbd_device *usbd_dev, uint8_t budget);
+
 typedef int (*usbd_control_callback)(usbd_device *usbd_dev,
 		struct usb_setup_data *req, uint8_t **buf, uint16_t *len,
 		void (**complete)(usbd_device *usbd_dev,
@@ -88,11 +93,25 @@ extern int usbd_register_control_callback(usbd_device *usbd_dev, uint8_t type,
 /* <usb_standard.c> */
 extern int usbd_register_set_config_callback(usbd_device *usbd_dev,
 	void (*callback)(usbd_device *usbd_dev, uint16_t wValue));
+extern uint16_t usbd_serialize_config_descriptor(
+		const struct usb_config_descriptor *cfg,
+		uint8_t *buf, uint16_t len);
+extern void usbd_register_config_descriptors(usbd_device *usbd_dev,
+					     const uint8_t * const *descs);
 
 /* Functions to be provided by the hardware abstraction layer */
 extern void usbd_poll(usbd_device *usbd_dev);
 extern void usbd_disconnect(usbd_device *usbd_dev, bool disconnected);
 
+/*
+ * Flag to be OR'ed into the type argument of usbd_ep_setup() to request a
+ * double-buffered bulk or isochronous endpoint. A double-buffered endpoint
+ * uses both hardware buffers for one direction, so it cannot share its
+ * number with an endpoint of the other direction. Drivers without double
+ * buffering support ignore the flag.
+ */
+#define USBD_EP_DOUBLEBUF	0x80
+
 extern void usbd_ep_setup(usbd_device *usbd_dev, uint8_t addr, uint8_t type,
 		uint16_t max_size,
 		void (*callback)(usbd_device *usbd_dev, uint8_t ep));
@@ -112,6 +131,31 @@ extern void usbd_ep_nak_set(usbd_device *usbd_dev, uint8_t addr, uint8_t nak);
 /* Optional */
 extern void usbd_cable_connect(usbd_device *usbd_dev, uint8_t on);
 
+/* <usb_transfer.c> */
+
+/** Multi-packet endpoint transfer, see usbd_ep_transfer(). */
+struct usbd_transfer {
+	void *buf;		/**< Data to send, or buffer to receive into */
+	uint16_t len;		/**< Bytes to send, or size of buf */
+	uint16_t actual;	/**< Bytes transferred, set on completion */
+	uint8_t flags;		/**< USBD_TRANSFER_* flags */
+	/** Called once the whole transfer has finished. */
+	void (*complete)(usbd_device *usbd_dev, struct usbd_transfer *xfer);
+
+	/* Private to the USB stack */
+	uint16_t queued;
+	uint8_t inflight;
+	uint8_t state;
+	void (*ep_callback)(usbd_device *usbd_dev, uint8_t ep);
+};
+
+/** Terminate IN transfers that are a multiple of the packet size with a
+ * zero-length packet. */
+#define USBD_TRANSFER_ZLP	(1 << 0)
+
+extern int usbd_ep_transfer(usbd_device *usbd_dev, uint8_t addr,
+			    struct usbd_transfer *xfer);
+
 END_DECLS
 
 #endif
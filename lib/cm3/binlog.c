@@ -0,0 +1,93 @@
+/** @addtogroup CM3_binlog_defines */
+
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stddef.h>
+#include <libopencm3/cm3/binlog.h>
+
+/**@{*/
+
+/* Offset, count and arguments at up to 5 bytes each */
+#define MSG_SIZE_MAX	(5 + 1 + 5 * BINLOG_MAX_ARGS)
+
+static uint32_t (*binlog_output)(const void *data, uint32_t len);
+static volatile uint32_t dropped;
+
+static uint8_t *binlog_put(uint8_t *p, uint32_t val)
+{
+	while (val >= 0x80) {
+		*p++ = val | 0x80;
+		val >>= 7;
+	}
+	*p++ = val;
+
+	return p;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Set where messages are sent to
+ *
+ * @param[in] output Function taking a whole message and returning the
+ * number of bytes it took, e.g. itm_log_write(). NULL discards messages.
+ */
+void binlog_set_output(uint32_t (*output)(const void *data, uint32_t len))
+{
+	binlog_output = output;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Send a message, used by BINLOG()
+ *
+ * @param[in] id Offset of the format string in the .binlog section
+ * @param[in] args Arguments
+ * @param[in] nargs Number of arguments, more than @ref BINLOG_MAX_ARGS are
+ * left out
+ */
+void binlog_write(uint32_t id, const uint32_t *args, uint32_t nargs)
+{
+	uint8_t msg[MSG_SIZE_MAX];
+	uint8_t *p;
+	uint32_t i;
+
+	if (!binlog_output) {
+		return;
+	}
+
+	if (nargs > BINLOG_MAX_ARGS) {
+		nargs = BINLOG_MAX_ARGS;
+	}
+
+	p = binlog_put(msg, id);
+	*p++ = nargs;
+	for (i = 0; i < nargs; i++) {
+		p = binlog_put(p, args[i]);
+	}
+
+	if (binlog_output(msg, p - msg) != (uint32_t)(p - msg)) {
+		dropped++;
+	}
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Number of messages the output did not take */
+uint32_t binlog_dropped(void)
+{
+	return dropped;
+}
+
+/**@}*/
@@ -50,6 +50,36 @@ bool dwt_enable_cycle_counter(void)
 	/* not supported on other architectures */
 	return false;
 }
+
+/*---------------------------------------------------------------------------*/
+/** @brief DebugTrace Make sure the CPU cycle counter runs
+ *
+ * Like @ref dwt_enable_cycle_counter, but leaves the counter alone if it is
+ * running already, so that other users of it, such as the monotonic clock,
+ * do not see it jump.
+ *
+ * @returns true, if the cycle counter is available
+ */
+bool dwt_ensure_cycle_counter(void)
+{
+#if defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__)
+	if ((SCS_DEMCR & SCS_DEMCR_TRCENA) &&
+	    (DWT_CTRL & DWT_CTRL_CYCCNTENA)) {
+		return true;
+	}
+
+	SCS_DEMCR |= SCS_DEMCR_TRCENA;
+	if (DWT_CTRL & DWT_CTRL_NOCYCCNT) {
+		return false;		/* Not supported in implementation */
+	}
+
+	DWT_CTRL |= DWT_CTRL_CYCCNTENA;
+	return true;
+#else
+	return false;			/* Not supported on ARMv6M */
+#endif
+}
+
 /*---------------------------------------------------------------------------*/
 /** @brief DebugTrace Read the CPU cycle counter
  *
@@ -0,0 +1,153 @@
+/** @addtogroup CM3_irqtrace_defines
+ *
+ * A stack indexed by the nesting depth holds the entry time of each active
+ * handler and the cycles its preempting handlers took, which are taken off
+ * its own time on exit.
+ */
+
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stddef.h>
+#include <libopencm3/cm3/dwt.h>
+#include <libopencm3/cm3/nvic.h>
+#include <libopencm3/cm3/sync.h>
+#include <libopencm3/cm3/irqtrace.h>
+
+/**@{*/
+
+static struct irqtrace_stats stats[NVIC_IRQ_COUNT];
+static uint32_t start[IRQTRACE_MAX_DEPTH];
+static uint32_t nested[IRQTRACE_MAX_DEPTH];
+static uint8_t depth;
+static uint8_t max_depth;
+
+static inline uint32_t irqtrace_cycles(void)
+{
+#if defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__)
+	return DWT_CYCCNT;
+#else
+	return 0;
+#endif
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Enable the cycle counter and clear the statistics
+ *
+ * @returns false if the cycle counter is not available, in which case only
+ * counts and nesting are kept
+ */
+bool irqtrace_init(void)
+{
+	irqtrace_reset();
+
+	return dwt_ensure_cycle_counter();
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Account for the start of a handler, called by the wrappers */
+void irqtrace_enter(void)
+{
+	uint32_t primask = cm_critical_enter();
+
+	if (depth < IRQTRACE_MAX_DEPTH) {
+		nested[depth] = 0;
+		start[depth] = irqtrace_cycles();
+	}
+	depth++;
+	if (depth > max_depth) {
+		max_depth = depth;
+	}
+
+	cm_critical_exit(primask);
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Account for the end of a handler, called by the wrappers
+ *
+ * @param[in] irq Interrupt number of the handler
+ */
+void irqtrace_exit(uint32_t irq)
+{
+	uint32_t primask = cm_critical_enter();
+	uint32_t now = irqtrace_cycles();
+	struct irqtrace_stats *s = &stats[irq];
+	uint32_t elapsed;
+
+	if (depth > s->max_depth) {
+		s->max_depth = depth;
+	}
+	s->count++;
+
+	depth--;
+	if (depth < IRQTRACE_MAX_DEPTH) {
+		elapsed = now - start[depth];
+		if (depth) {
+			nested[depth - 1] += elapsed;
+		}
+		elapsed -= nested[depth];
+
+		s->total += elapsed;
+		if (elapsed > s->max) {
+			s->max = elapsed;
+		}
+	}
+
+	cm_critical_exit(primask);
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Statistics of an interrupt
+ *
+ * @param[in] irq Interrupt number
+ * @returns Statistics, NULL if irq is out of range
+ */
+const struct irqtrace_stats *irqtrace_get(uint32_t irq)
+{
+	if (irq >= NVIC_IRQ_COUNT) {
+		return NULL;
+	}
+
+	return &stats[irq];
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Deepest nesting of traced handlers seen */
+uint8_t irqtrace_get_max_depth(void)
+{
+	return max_depth;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Clear all statistics */
+void irqtrace_reset(void)
+{
+	uint32_t primask = cm_critical_enter();
+	uint32_t i;
+
+	for (i = 0; i < NVIC_IRQ_COUNT; i++) {
+		stats[i].count = 0;
+		stats[i].max = 0;
+		stats[i].total = 0;
+		stats[i].max_depth = 0;
+	}
+	max_depth = depth;
+
+	cm_critical_exit(primask);
+}
+
+/**@}*/
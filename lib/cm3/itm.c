@@ -0,0 +1,159 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Those are defined only on CM3 or CM4 */
+#if defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__)
+
+#include <libopencm3/cm3/scs.h>
+#include <libopencm3/cm3/itm.h>
+#include <libopencm3/cm3/ring.h>
+#include <libopencm3/cm3/sync.h>
+
+/*
+ * Messages are queued whole into a RAM ring, with interrupts masked only
+ * for the copy, and moved to the stimulus port in words for as long as its
+ * FIFO takes them. Draining never waits, so nothing blocks when no debugger
+ * is listening; messages that do not fit are dropped and counted.
+ */
+
+static struct ring_spsc log_ring;
+static uint8_t log_port;
+static volatile uint32_t log_busy;
+static volatile uint32_t log_dropped;
+
+/*---------------------------------------------------------------------------*/
+/** @brief ITM Enable stimulus ports
+ *
+ * Enables trace and the ITM, and the given stimulus ports. A debugger may
+ * have done this already.
+ *
+ * @param[in] ports Bitmask of the ports 0 to 31 to enable
+ * @param[in] trace_bus_id ATB ID of the ITM, non-zero
+ */
+void itm_enable(uint32_t ports, uint8_t trace_bus_id)
+{
+	SCS_DEMCR |= SCS_DEMCR_TRCENA;
+	ITM_LAR = ITM_LAR_KEY;
+	ITM_TCR = ((trace_bus_id << 16) & ITM_TCR_TRACE_BUS_ID_MASK) |
+		  ITM_TCR_ITMENA;
+	ITM_TER[0] |= ports;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief ITM Set up the buffered logger
+ *
+ * @param[in] port Stimulus port to log to, 0 to 31
+ * @param[in] buf Ring buffer, which must stay valid
+ * @param[in] size Size of buf, a power of two
+ */
+void itm_log_init(uint8_t port, uint8_t *buf, uint32_t size)
+{
+	ring_spsc_init(&log_ring, buf, size);
+	log_port = port;
+	log_busy = 0;
+	log_dropped = 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief ITM Queue a message
+ *
+ * May be called from any context. Queues the whole message or nothing, and
+ * passes as much as the port takes at once on to it.
+ *
+ * @param[in] data Message
+ * @param[in] len Length of the message
+ * @returns len, or 0 if the message was dropped
+ */
+uint32_t itm_log_write(const void *data, uint32_t len)
+{
+	uint32_t primask = cm_critical_enter();
+
+	if (ring_spsc_free(&log_ring) < len) {
+		log_dropped++;
+		cm_critical_exit(primask);
+		return 0;
+	}
+	ring_spsc_write(&log_ring, data, len);
+	cm_critical_exit(primask);
+
+	itm_log_flush();
+
+	return len;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief ITM Queue a NUL terminated string, see itm_log_write() */
+uint32_t itm_log_puts(const char *s)
+{
+	uint32_t len = 0;
+
+	while (s[len]) {
+		len++;
+	}
+
+	return itm_log_write(s, len);
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief ITM Pass queued data on to the stimulus port
+ *
+ * Returns as soon as the port FIFO is full or the queue is empty. Call it
+ * from the idle loop or a periodic handler, to send what was left over by
+ * itm_log_write(). Returns at once if it is running already in another
+ * context.
+ */
+void itm_log_flush(void)
+{
+	uint8_t w[4];
+	uint32_t n;
+
+	if (!cm_atomic_cas(&log_busy, 0, 1)) {
+		return;
+	}
+
+	while ((ITM_TCR & ITM_TCR_ITMENA) && (ITM_TER[0] & (1 << log_port)) &&
+	       (ITM_STIM32(log_port) & ITM_STIM_FIFOREADY)) {
+		n = ring_spsc_used(&log_ring);
+		if (!n) {
+			break;
+		}
+
+		/* A stimulus write sends 1, 2 or 4 bytes. */
+		n = (n >= 4) ? 4 : (n >= 2) ? 2 : 1;
+		ring_spsc_read(&log_ring, w, n);
+		if (n == 4) {
+			ITM_STIM32(log_port) = w[0] | (w[1] << 8) |
+					       (w[2] << 16) | (w[3] << 24);
+		} else if (n == 2) {
+			ITM_STIM16(log_port) = w[0] | (w[1] << 8);
+		} else {
+			ITM_STIM8(log_port) = w[0];
+		}
+	}
+
+	__dmb();
+	log_busy = 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief ITM Number of messages dropped as the queue was full */
+uint32_t itm_log_dropped(void)
+{
+	return log_dropped;
+}
+
+#endif
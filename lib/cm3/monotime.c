@@ -0,0 +1,177 @@
+/** @addtogroup CM3_monotime_defines
+ *
+ * The overflow of the underlying counter is accounted for with interrupts
+ * masked. On the DWT path, a read that finds the counter below the last
+ * sample has seen it wrap; as monotime_tick() samples it on every SysTick,
+ * no two reads are a whole wrap apart. The cycle counter is never reset, the
+ * clock counts from its value at monotime_init().
+ *
+ * On the SysTick path, COUNTFLAG means a period has ended that
+ * monotime_tick() has not counted yet, so the read accounts for it itself.
+ * Unlike PENDSTSET, COUNTFLAG is not cleared by taking the exception, but by
+ * reading STK_CSR, so a read latches it until monotime_tick() runs.
+ */
+
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <libopencm3/cm3/dwt.h>
+#include <libopencm3/cm3/sync.h>
+#include <libopencm3/cm3/systick.h>
+#include <libopencm3/cm3/monotime.h>
+
+/**@{*/
+
+struct monotime_factors monotime_scale;
+
+static bool use_dwt;
+static uint32_t frequency;
+/* DWT path: upper half and last sampled lower half of the count */
+static uint32_t dwt_high;
+static uint32_t dwt_last;
+/* DWT path: counter value at monotime_init() */
+static uint32_t dwt_start;
+/* SysTick path: count at the start of the current period */
+static uint64_t stk_base;
+/* SysTick path: the current period ended, not yet counted by stk_base */
+static bool stk_wrapped;
+
+static uint64_t monotime_read_locked(void)
+{
+	uint32_t period, cvr;
+
+#if defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__)
+	if (use_dwt) {
+		cvr = DWT_CYCCNT;
+		if (cvr < dwt_last) {
+			dwt_high++;
+		}
+		dwt_last = cvr;
+		return (((uint64_t)dwt_high << 32) | cvr) - dwt_start;
+	}
+#endif
+
+	period = systick_get_reload() + 1;
+	cvr = STK_CVR;
+	if (STK_CSR & STK_CSR_COUNTFLAG) {
+		stk_wrapped = true;
+	}
+	if (stk_wrapped) {
+		/* Wrapped, maybe after the read above: take a fresh value. */
+		cvr = STK_CVR;
+		return stk_base + period + (period - 1 - cvr);
+	}
+
+	return stk_base + (period - 1 - cvr);
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Start the clock
+ *
+ * Uses the DWT cycle counter if available, SysTick otherwise, which must
+ * already be running with its interrupt enabled. The clock starts at 0.
+ *
+ * On the SysTick path, the clock owns COUNTFLAG: the application must not
+ * read it through systick_get_countflag() or STK_CSR.
+ *
+ * @param[in] ahb Core clock in Hz. On the SysTick path, the clock source
+ * selected in STK_CSR decides whether it counts at ahb or ahb / 8.
+ * @returns Frequency of the clock in Hz
+ */
+uint32_t monotime_init(uint32_t ahb)
+{
+	uint32_t primask = cm_critical_enter();
+
+	use_dwt = dwt_ensure_cycle_counter();
+	if (use_dwt || (STK_CSR & STK_CSR_CLKSOURCE)) {
+		frequency = ahb;
+	} else {
+		frequency = ahb / 8;
+	}
+
+	dwt_high = 0;
+	dwt_last = 0;
+	dwt_start = 0;
+	stk_base = 0;
+	stk_wrapped = false;
+	if (use_dwt) {
+		dwt_start = dwt_read_cycle_counter();
+		dwt_last = dwt_start;
+	} else {
+		/* Any earlier wrap is not ours to count. */
+		(void)STK_CSR;
+		stk_base -= monotime_read_locked();
+	}
+
+	monotime_scale.ns_per_count = (1000000000ULL << 32) / frequency;
+	monotime_scale.us_per_count = (1000000ULL << 32) / frequency;
+	monotime_scale.count_per_ns = ((uint64_t)frequency << 32) / 1000000000;
+	monotime_scale.count_per_us = ((uint64_t)frequency << 32) / 1000000;
+
+	cm_critical_exit(primask);
+
+	return frequency;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Read the clock
+ *
+ * May be called from any context, including interrupt handlers.
+ *
+ * @returns Counts since monotime_init(), see monotime_get_frequency()
+ */
+uint64_t monotime_read(void)
+{
+	uint32_t primask = cm_critical_enter();
+	uint64_t now = monotime_read_locked();
+
+	cm_critical_exit(primask);
+
+	return now;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Account for a SysTick period
+ *
+ * To be called from sys_tick_handler(), before anything in it reads the
+ * clock.
+ */
+void monotime_tick(void)
+{
+	uint32_t primask = cm_critical_enter();
+
+	if (use_dwt) {
+		monotime_read_locked();
+	} else {
+		/* Consume the COUNTFLAG of the wrap counted here. */
+		(void)STK_CSR;
+		stk_base += systick_get_reload() + 1;
+		stk_wrapped = false;
+	}
+
+	cm_critical_exit(primask);
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Frequency of the clock in Hz, as returned by monotime_init() */
+uint32_t monotime_get_frequency(void)
+{
+	return frequency;
+}
+
+/**@}*/
+
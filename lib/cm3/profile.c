@@ -0,0 +1,253 @@
+/** @addtogroup CM3_profile_defines
+ *
+ * profile_begin() takes the event counters before the cycle counter, and
+ * profile_end() takes them in the opposite order, so that as little as
+ * possible of the probe itself is counted. What remains is measured by
+ * profile_init() with an empty probe and taken off every run.
+ */
+
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stddef.h>
+#include <libopencm3/cm3/dwt.h>
+#include <libopencm3/cm3/sync.h>
+#include <libopencm3/cm3/profile.h>
+
+/**@{*/
+
+/* Those are defined only on CM3 or CM4 */
+#if defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__)
+
+#define CALIBRATION_RUNS	8
+#define LINE_SIZE		128
+
+static struct profile_probe *probe_list;
+static uint32_t overhead_cycles;
+static uint8_t overhead_events[PROFILE_EVENT_COUNT];
+
+static void profile_read_events(uint8_t *ev)
+{
+	ev[PROFILE_EVENT_CPI] = DWT_CPICNT;
+	ev[PROFILE_EVENT_EXC] = DWT_EXCCNT;
+	ev[PROFILE_EVENT_SLEEP] = DWT_SLEEPCNT;
+	ev[PROFILE_EVENT_LSU] = DWT_LSUCNT;
+	ev[PROFILE_EVENT_FOLD] = DWT_FOLDCNT;
+}
+
+static void profile_list(struct profile_probe *p)
+{
+	uint32_t primask = cm_critical_enter();
+
+	if (!p->listed) {
+		p->next = probe_list;
+		probe_list = p;
+		p->listed = true;
+	}
+	cm_critical_exit(primask);
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Enable the DWT counters and measure the probe overhead
+ *
+ * @returns false if the cycle counter is not available
+ */
+bool profile_init(void)
+{
+	struct profile_probe cal = PROFILE_PROBE_INIT(NULL);
+	int i;
+
+	if (!dwt_ensure_cycle_counter()) {
+		return false;
+	}
+	DWT_CTRL |= DWT_CTRL_CPIEVTENA | DWT_CTRL_EXCEVTENA |
+		    DWT_CTRL_SLEEPEVTENA | DWT_CTRL_LSUEVTENA |
+		    DWT_CTRL_FOLDEVTENA;
+
+	overhead_cycles = 0;
+	for (i = 0; i < PROFILE_EVENT_COUNT; i++) {
+		overhead_events[i] = 0;
+	}
+
+	/* Keep the best run, the others may have been interrupted. */
+	cal.listed = true;
+	for (i = 0; i < CALIBRATION_RUNS; i++) {
+		profile_begin(&cal);
+		profile_end(&cal);
+	}
+	overhead_cycles = cal.min;
+	for (i = 0; i < PROFILE_EVENT_COUNT; i++) {
+		overhead_events[i] = cal.events[i] / CALIBRATION_RUNS;
+	}
+
+	return true;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Start a run of a probe
+ *
+ * The first run adds the probe to the ones listed by profile_dump().
+ */
+void profile_begin(struct profile_probe *p)
+{
+	if (!p->listed) {
+		profile_list(p);
+	}
+
+	profile_read_events(p->start_events);
+	p->start_cycles = DWT_CYCCNT;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief End a run of a probe and account for it */
+void profile_end(struct profile_probe *p)
+{
+	uint32_t cycles = DWT_CYCCNT;
+	uint8_t ev[PROFILE_EVENT_COUNT];
+	uint8_t delta;
+	int i;
+
+	profile_read_events(ev);
+
+	cycles -= p->start_cycles;
+	cycles = (cycles > overhead_cycles) ? cycles - overhead_cycles : 0;
+
+	if (cycles < p->min) {
+		p->min = cycles;
+	}
+	if (cycles > p->max) {
+		p->max = cycles;
+	}
+	p->total += cycles;
+	p->count++;
+
+	for (i = 0; i < PROFILE_EVENT_COUNT; i++) {
+		delta = ev[i] - p->start_events[i];
+		if (delta > overhead_events[i]) {
+			p->events[i] += delta - overhead_events[i];
+		}
+	}
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Mean cycles of a run, 0 before the first one */
+uint32_t profile_mean(const struct profile_probe *p)
+{
+	if (!p->count) {
+		return 0;
+	}
+
+	return p->total / p->count;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Clear the statistics of a probe */
+void profile_reset(struct profile_probe *p)
+{
+	int i;
+
+	p->count = 0;
+	p->min = 0xffffffff;
+	p->max = 0;
+	p->total = 0;
+	for (i = 0; i < PROFILE_EVENT_COUNT; i++) {
+		p->events[i] = 0;
+	}
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Clear the statistics of all probes that have run */
+void profile_reset_all(void)
+{
+	struct profile_probe *p;
+
+	for (p = probe_list; p; p = p->next) {
+		profile_reset(p);
+	}
+}
+
+static char *profile_put_str(char *s, char *end, const char *str)
+{
+	while (*str && (s < end)) {
+		*s++ = *str++;
+	}
+
+	return s;
+}
+
+static char *profile_put_uint(char *s, char *end, const char *label,
+			      uint32_t val)
+{
+	char digits[10];
+	int n = 0;
+
+	s = profile_put_str(s, end, label);
+	do {
+		digits[n++] = '0' + (val % 10);
+		val /= 10;
+	} while (val);
+	while (n && (s < end)) {
+		*s++ = digits[--n];
+	}
+
+	return s;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Print the statistics of all probes that have run
+ *
+ * Prints one line per probe, most recently added first, e.g.
+ * "usbd_poll n=1000 min=112 max=2230 mean=140 cpi=31 exc=0 sleep=0 lsu=12
+ * fold=2", where the event counts are means per run as well.
+ *
+ * @param[in] print Function to output a NUL terminated line, without newline
+ */
+void profile_dump(void (*print)(const char *line))
+{
+	static const char * const labels[PROFILE_EVENT_COUNT] = {
+		" cpi=", " exc=", " sleep=", " lsu=", " fold=",
+	};
+	char line[LINE_SIZE];
+	char *end = line + sizeof(line) - 1;
+	struct profile_probe *p;
+	char *s;
+	int i;
+
+	for (p = probe_list; p; p = p->next) {
+		if (!p->count) {
+			continue;
+		}
+
+		s = profile_put_str(line, end, p->name ? p->name : "?");
+		s = profile_put_uint(s, end, " n=", p->count);
+		s = profile_put_uint(s, end, " min=", p->min);
+		s = profile_put_uint(s, end, " max=", p->max);
+		s = profile_put_uint(s, end, " mean=", profile_mean(p));
+		for (i = 0; i < PROFILE_EVENT_COUNT; i++) {
+			s = profile_put_uint(s, end, labels[i],
+					     p->events[i] / p->count);
+		}
+		*s = '\0';
+
+		print(line);
+	}
+}
+
+#endif
+
+/**@}*/
+
@@ -0,0 +1,260 @@
+/** @addtogroup CM3_ring_defines
+ *
+ * The multi producer queue follows D. Vyukov's bounded MPMC queue: every slot
+ * carries a sequence number that tells producers and consumers whether it is
+ * theirs to fill or to drain, so only the claim of a slot needs an atomic
+ * read-modify-write.
+ */
+
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <libopencm3/cm3/sync.h>
+#include <libopencm3/cm3/ring.h>
+
+/**@{*/
+
+/*---------------------------------------------------------------------------*/
+/** @brief Initialize a single producer, single consumer ring
+ *
+ * @param[in] ring Ring to initialize
+ * @param[in] buf Storage for the ring
+ * @param[in] size Size of buf in bytes, a power of two
+ */
+void ring_spsc_init(struct ring_spsc *ring, uint8_t *buf, uint32_t size)
+{
+	ring->buf = buf;
+	ring->mask = size - 1;
+	ring->head = 0;
+	ring->tail = 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Append data to a ring, producer side
+ *
+ * @param[in] ring Ring to write to
+ * @param[in] data Bytes to append
+ * @param[in] len Number of bytes in data
+ * @returns Number of bytes appended, less than len if the ring filled up
+ */
+uint32_t ring_spsc_write(struct ring_spsc *ring, const uint8_t *data,
+			 uint32_t len)
+{
+	uint32_t head = ring->head;
+	uint32_t room = ring_spsc_free(ring);
+	uint32_t i;
+
+	/* Read once, the consumer may make more room meanwhile. */
+	if (len > room) {
+		len = room;
+	}
+
+	/* The free space must be read before the slots are overwritten. */
+	__dmb();
+
+	for (i = 0; i < len; i++) {
+		ring->buf[(head + i) & ring->mask] = data[i];
+	}
+
+	/* Publish the data only once it is in the ring. */
+	__dmb();
+	ring->head = head + len;
+
+	return len;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Copy data out of a ring without taking it, consumer side
+ *
+ * For consumers that may fail to pass the data on: ring_spsc_skip() then
+ * takes out the part that was used.
+ *
+ * @param[in] ring Ring to read from
+ * @param[out] data Buffer for the bytes
+ * @param[in] len Size of data
+ * @returns Number of bytes copied
+ */
+uint32_t ring_spsc_peek(const struct ring_spsc *ring, uint8_t *data,
+			uint32_t len)
+{
+	uint32_t tail = ring->tail;
+	uint32_t avail = ring_spsc_used(ring);
+	uint32_t i;
+
+	/* Read once, the producer may add more meanwhile. */
+	if (len > avail) {
+		len = avail;
+	}
+
+	/* The data must not be read before the producer published it. */
+	__dmb();
+
+	for (i = 0; i < len; i++) {
+		data[i] = ring->buf[(tail + i) & ring->mask];
+	}
+
+	return len;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Drop data from a ring, consumer side
+ *
+ * @param[in] ring Ring to drop from
+ * @param[in] len Number of bytes, at most ring_spsc_used()
+ */
+void ring_spsc_skip(struct ring_spsc *ring, uint32_t len)
+{
+	/* Hand the slots back only once they have been read. */
+	__dmb();
+	ring->tail += len;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Take data out of a ring, consumer side
+ *
+ * @param[in] ring Ring to read from
+ * @param[out] data Buffer for the bytes
+ * @param[in] len Size of data
+ * @returns Number of bytes read
+ */
+uint32_t ring_spsc_read(struct ring_spsc *ring, uint8_t *data, uint32_t len)
+{
+	len = ring_spsc_peek(ring, data, len);
+	ring_spsc_skip(ring, len);
+
+	return len;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Append a single byte to a ring, producer side
+ *
+ * @returns false if the ring is full
+ */
+bool ring_spsc_put(struct ring_spsc *ring, uint8_t c)
+{
+	return ring_spsc_write(ring, &c, 1) == 1;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Take a single byte out of a ring, consumer side
+ *
+ * @returns false if the ring is empty
+ */
+bool ring_spsc_get(struct ring_spsc *ring, uint8_t *c)
+{
+	return ring_spsc_read(ring, c, 1) == 1;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Initialize a multi producer, multi consumer queue
+ *
+ * @param[in] ring Queue to initialize
+ * @param[in] slots Storage for the queue
+ * @param[in] size Number of slots, a power of two
+ */
+void ring_mpmc_init(struct ring_mpmc *ring, struct ring_mpmc_slot *slots,
+		    uint32_t size)
+{
+	uint32_t i;
+
+	for (i = 0; i < size; i++) {
+		slots[i].seq = i;
+	}
+
+	ring->slots = slots;
+	ring->mask = size - 1;
+	ring->head = 0;
+	ring->tail = 0;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Push a word to a queue
+ *
+ * Safe to call from any number of threads and interrupt handlers at once.
+ *
+ * @returns false if the queue is full
+ */
+bool ring_mpmc_push(struct ring_mpmc *ring, uint32_t val)
+{
+	struct ring_mpmc_slot *slot;
+	uint32_t pos = ring->head;
+	int32_t dif;
+
+	for (;;) {
+		slot = &ring->slots[pos & ring->mask];
+		dif = (int32_t)(slot->seq - pos);
+
+		if (dif == 0) {
+			/* The slot is free, try to claim it. */
+			if (cm_atomic_cas(&ring->head, pos, pos + 1)) {
+				break;
+			}
+		} else if (dif < 0) {
+			/* The slot still holds an entry from the last lap. */
+			return false;
+		}
+		pos = ring->head;
+	}
+
+	__dmb();
+	slot->data = val;
+	__dmb();
+	slot->seq = pos + 1;
+
+	return true;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Pop a word from a queue
+ *
+ * Safe to call from any number of threads and interrupt handlers at once.
+ * An entry whose producer was interrupted before finishing its push is not
+ * visible yet, the queue then reads as empty up to that entry.
+ *
+ * @returns false if the queue is empty
+ */
+bool ring_mpmc_pop(struct ring_mpmc *ring, uint32_t *val)
+{
+	struct ring_mpmc_slot *slot;
+	uint32_t pos = ring->tail;
+	int32_t dif;
+
+	for (;;) {
+		slot = &ring->slots[pos & ring->mask];
+		dif = (int32_t)(slot->seq - (pos + 1));
+
+		if (dif == 0) {
+			/* The slot is filled, try to claim it. */
+			if (cm_atomic_cas(&ring->tail, pos, pos + 1)) {
+				break;
+			}
+		} else if (dif < 0) {
+			return false;
+		}
+		pos = ring->tail;
+	}
+
+	__dmb();
+	*val = slot->data;
+	__dmb();
+	slot->seq = pos + ring->mask + 1;
+
+	return true;
+}
+
+/**@}*/
+
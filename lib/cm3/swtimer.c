@@ -0,0 +1,292 @@
+/** @addtogroup CM3_swtimer_defines
+ *
+ * A timer lives in the wheel slot selected by the low bits of its expiry
+ * tick. Each tick only looks at one slot, and only the timers there whose
+ * expiry is the current tick fire; the others are due in a later turn of
+ * the wheel.
+ */
+
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stddef.h>
+#include <libopencm3/cm3/systick.h>
+#include <libopencm3/cm3/sync.h>
+#include <libopencm3/cm3/swtimer.h>
+
+/**@{*/
+
+#define WHEEL_MASK	(SWTIMER_WHEEL_SIZE - 1)
+
+static struct swtimer *wheel[SWTIMER_WHEEL_SIZE];
+static volatile uint32_t now;
+/* SysTick clocks per tick */
+static uint32_t tick_clocks;
+/* Ticks the pending SysTick interrupt stands for after tickless idle */
+static uint32_t skip;
+
+static void swtimer_insert(struct swtimer *t)
+{
+	struct swtimer **head = &wheel[t->expires & WHEEL_MASK];
+
+	t->prev = NULL;
+	t->next = *head;
+	if (*head) {
+		(*head)->prev = t;
+	}
+	*head = t;
+	t->active = true;
+}
+
+static void swtimer_remove(struct swtimer *t)
+{
+	if (t->prev) {
+		t->prev->next = t->next;
+	} else {
+		wheel[t->expires & WHEEL_MASK] = t->next;
+	}
+	if (t->next) {
+		t->next->prev = t->prev;
+	}
+	t->active = false;
+}
+
+/* Ticks until the earliest expiry, 0xffffffff if no timer is running. */
+static uint32_t swtimer_next_deadline(void)
+{
+	uint32_t best = 0xffffffff;
+	struct swtimer *t;
+	int i;
+
+	for (i = 0; i < SWTIMER_WHEEL_SIZE; i++) {
+		for (t = wheel[i]; t; t = t->next) {
+			if (t->expires - now < best) {
+				best = t->expires - now;
+			}
+		}
+	}
+
+	return best;
+}
+
+/* Advance by one tick and run the timers that expire on it. */
+static void swtimer_advance(void)
+{
+	uint32_t primask = cm_critical_enter();
+	struct swtimer *t;
+
+	now++;
+
+	/*
+	 * Look for the next due timer from the start of the slot every time,
+	 * as a callback may start or stop any timer.
+	 */
+	for (;;) {
+		for (t = wheel[now & WHEEL_MASK]; t; t = t->next) {
+			if (t->expires == now) {
+				break;
+			}
+		}
+		if (!t) {
+			break;
+		}
+
+		swtimer_remove(t);
+		if (t->period) {
+			t->expires = now + t->period;
+			swtimer_insert(t);
+		}
+
+		cm_critical_exit(primask);
+		t->callback(t->arg);
+		primask = cm_critical_enter();
+	}
+
+	cm_critical_exit(primask);
+}
+
+/*
+ * Restart the stopped counter with a single period of load + 1 clocks, the
+ * following ones being ticks again. The counter only takes the reload value
+ * over on its next clock edge, up to 8 CPU cycles after enabling with the
+ * AHB/8 clock or later still with an external reference, so the tick period
+ * must not be restored before then. load must not be 0.
+ */
+static void swtimer_reload_once(uint32_t load)
+{
+	systick_set_reload(load);
+	systick_clear();
+	systick_counter_enable();
+	while (systick_get_value() == 0) {
+	}
+	systick_set_reload(tick_clocks - 1);
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Initialize the timer service
+ *
+ * SysTick must already be set up for the tick period and have its interrupt
+ * enabled, e.g. with systick_set_frequency().
+ */
+void swtimer_init(void)
+{
+	int i;
+
+	for (i = 0; i < SWTIMER_WHEEL_SIZE; i++) {
+		wheel[i] = NULL;
+	}
+	now = 0;
+	skip = 0;
+	tick_clocks = systick_get_reload() + 1;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Start or restart a timer
+ *
+ * @param[in] t Timer, which must stay valid while it is running
+ * @param[in] ticks Ticks until the first expiry, at least 1
+ * @param[in] period Ticks between further expiries, 0 for a one-shot timer
+ * @param[in] callback Function to call from swtimer_tick() on expiry
+ * @param[in] arg Argument passed to callback
+ */
+void swtimer_start(struct swtimer *t, uint32_t ticks, uint32_t period,
+		   void (*callback)(void *arg), void *arg)
+{
+	uint32_t primask = cm_critical_enter();
+
+	if (t->active) {
+		swtimer_remove(t);
+	}
+
+	t->expires = now + (ticks ? ticks : 1);
+	t->period = period;
+	t->callback = callback;
+	t->arg = arg;
+	swtimer_insert(t);
+
+	cm_critical_exit(primask);
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Stop a timer, if it is running */
+void swtimer_stop(struct swtimer *t)
+{
+	uint32_t primask = cm_critical_enter();
+
+	if (t->active) {
+		swtimer_remove(t);
+	}
+
+	cm_critical_exit(primask);
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Check whether a timer is running */
+bool swtimer_is_active(const struct swtimer *t)
+{
+	return t->active;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Advance the timer service
+ *
+ * To be called from sys_tick_handler(). Runs the callbacks of all timers
+ * that have expired, also those of ticks skipped in tickless idle.
+ */
+void swtimer_tick(void)
+{
+	uint32_t n = skip ? skip : 1;
+
+	skip = 0;
+	while (n--) {
+		swtimer_advance();
+	}
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Number of ticks since swtimer_init() */
+uint32_t swtimer_get_ticks(void)
+{
+	return now;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Sleep until the next timer expiry or interrupt
+ *
+ * To be called from the idle loop instead of WFI. If the next timer is more
+ * than one tick away, the current SysTick period is stretched up to it, as
+ * far as the 24 bit counter allows. If another interrupt wakes the core
+ * early, the ticks slept so far are accounted for and SysTick is realigned
+ * to the tick grid. Each stretched sleep may lose a few SysTick clocks.
+ */
+void swtimer_idle(void)
+{
+	uint32_t primask = cm_critical_enter();
+	uint32_t max = (STK_RVR_RELOAD - tick_clocks) / tick_clocks;
+	uint32_t delta = swtimer_next_deadline();
+	uint32_t first, load, elapsed, rest;
+
+	if (delta > max) {
+		delta = max;
+	}
+
+	if ((delta < 2) || skip) {
+		/* A pending interrupt still ends WFI with PRIMASK set. */
+		__asm__ volatile ("wfi");
+		cm_critical_exit(primask);
+		return;
+	}
+
+	/*
+	 * Stretch the current tick by delta - 1 whole ticks. The tick grid
+	 * then lies where the counter is a multiple of tick_clocks, the first
+	 * boundary being first clocks on.
+	 */
+	systick_counter_disable();
+	first = systick_get_value();
+	load = first + (delta - 1) * tick_clocks;
+	swtimer_reload_once(load);
+
+	__asm__ volatile ("wfi");
+
+	if (systick_get_countflag()) {
+		/* Slept up to the deadline, the pending SysTick covers it. */
+		skip = delta;
+	} else {
+		/*
+		 * No timer is due before delta, just count the tick
+		 * boundaries crossed and fire at the next one.
+		 */
+		systick_counter_disable();
+		elapsed = load - systick_get_value();
+		if (elapsed >= first) {
+			now += 1 + (elapsed - first) / tick_clocks;
+		}
+
+		rest = systick_get_value() % tick_clocks;
+		if (rest == 0) {
+			rest = tick_clocks;
+		}
+
+		swtimer_reload_once(rest > 1 ? rest - 1 : 1);
+	}
+
+	cm_critical_exit(primask);
+}
+
+/**@}*/
+
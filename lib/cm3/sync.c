@@ -19,52 +19,29 @@
 
 #include <libopencm3/cm3/sync.h>
 
-/* DMB is supported on CM0 */
-void __dmb()
-{
-	__asm__ volatile ("dmb");
-}
-
 /* Those are defined only on CM3 or CM4 */
 #if defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__)
 
-uint32_t __ldrex(volatile uint32_t *addr)
-{
-	uint32_t res;
-	__asm__ volatile ("ldrex %0, [%1]" : "=r" (res) : "r" (addr));
-	return res;
-}
-
-uint32_t __strex(uint32_t val, volatile uint32_t *addr)
-{
-	uint32_t res;
-	__asm__ volatile ("strex %0, %2, [%1]"
-			  : "=&r" (res) : "r" (addr), "r" (val));
-	return res;
-}
-
 void mutex_lock(mutex_t *m)
 {
-	while (!mutex_trylock(m));
+	/* Sleep until the holder signals the release. */
+	while (!mutex_trylock(m)) {
+		__wfe();
+	}
 }
 
 /* returns 1 if the lock was acquired */
 uint32_t mutex_trylock(mutex_t *m)
 {
-	uint32_t status = 0;
+	bool locked;
 
-	/* If the mutex is unlocked. */
-	if (__ldrex(m) == MUTEX_UNLOCKED) {
-		/* Try to lock it. */
-		status = __strex(MUTEX_LOCKED, m);
-	}
+	/* Lock it if it is unlocked. */
+	locked = cm_atomic_cas(m, MUTEX_UNLOCKED, MUTEX_LOCKED);
 
-	/* Execute the mysterious Data Memory Barrier instruction! */
+	/* Accesses to the protected resource must not start before. */
 	__dmb();
 
-	/* Did we get the lock? If not then try again
-	 * by calling this function once more. */
-	return status == 0;
+	return locked;
 }
 
 void mutex_unlock(mutex_t *m)
@@ -74,6 +51,99 @@ void mutex_unlock(mutex_t *m)
 
 	/* Free the lock. */
 	*m = MUTEX_UNLOCKED;
+
+	/* Wake up waiters once the store is visible. */
+	__dsb();
+	__sev();
 }
 
 #endif
+
+void semaphore_init(semaphore_t *s, uint32_t count)
+{
+	*s = count;
+}
+
+/* returns true if a unit was taken */
+bool semaphore_trywait(semaphore_t *s)
+{
+	uint32_t count;
+
+	do {
+		count = *s;
+		if (count == 0) {
+			return false;
+		}
+	} while (!cm_atomic_cas(s, count, count - 1));
+
+	__dmb();
+	return true;
+}
+
+void semaphore_wait(semaphore_t *s)
+{
+	while (!semaphore_trywait(s)) {
+		__wfe();
+	}
+}
+
+void semaphore_post(semaphore_t *s)
+{
+	__dmb();
+	cm_atomic_fetch_add(s, 1);
+	__dsb();
+	__sev();
+}
+
+void event_flags_set(event_flags_t *f, uint32_t flags)
+{
+	__dmb();
+	cm_atomic_set_bits(f, flags);
+	__dsb();
+	__sev();
+}
+
+void event_flags_clear(event_flags_t *f, uint32_t flags)
+{
+	cm_atomic_clear_bits(f, flags);
+}
+
+/*
+ * Wait until the flags selected by mask satisfy the condition, returning
+ * the selected flags that were set. With clear, exactly those are cleared,
+ * so of several waiters only one consumes an event.
+ */
+static uint32_t event_flags_wait(event_flags_t *f, uint32_t mask, bool all,
+				 bool clear)
+{
+	uint32_t flags, match;
+
+	for (;;) {
+		flags = *f;
+		match = flags & mask;
+
+		if (all ? (match == mask) : (match != 0)) {
+			if (!clear || cm_atomic_cas(f, flags, flags & ~match)) {
+				break;
+			}
+			/* Changed under us, check again right away. */
+			continue;
+		}
+		__wfe();
+	}
+
+	__dmb();
+	return match;
+}
+
+/* Wait for any of flags, returns those that were set */
+uint32_t event_flags_wait_any(event_flags_t *f, uint32_t flags, bool clear)
+{
+	return event_flags_wait(f, flags, false, clear);
+}
+
+/* Wait for all of flags */
+uint32_t event_flags_wait_all(event_flags_t *f, uint32_t flags, bool clear)
+{
+	return event_flags_wait(f, flags, true, clear);
+}
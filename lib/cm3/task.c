@@ -0,0 +1,303 @@
+/** @addtogroup CM3_task_defines
+ *
+ * A task that has not run yet starts from a stack prepared to look as if it
+ * had been switched out: a hardware exception frame with the entry point,
+ * below it r4-r11 and the EXC_RETURN value for thread mode on PSP. The
+ * PendSV handler saves and restores exactly that, plus s16-s31 when the
+ * EXC_RETURN value says the task has an FPU frame.
+ */
+
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stddef.h>
+#include <libopencm3/cm3/scb.h>
+#include <libopencm3/cm3/sync.h>
+#include <libopencm3/cm3/cortex.h>
+#include <libopencm3/cm3/task.h>
+#include "task_private.h"
+
+/**@{*/
+
+/* Those are defined only on CM3 or CM4 */
+#if defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__)
+
+/* Return to thread mode, using PSP, without FPU frame */
+#define EXC_RETURN_THREAD_PSP	0xFFFFFFFD
+/* Thumb state in the initial xPSR */
+#define XPSR_T			(1 << 24)
+
+#define IDLE_STACK_WORDS	TASK_STACK_MIN
+
+void pend_sv_handler(void) __attribute__((naked));
+
+__attribute__((used)) struct task *_task_cur;
+
+static struct task *task_list;
+static struct task idle_task;
+static uint32_t idle_stack[IDLE_STACK_WORDS] __attribute__((aligned(8)));
+static volatile uint32_t ticks;
+
+/* Set when libopencm3/cm3/workqueue.h is in use */
+void workqueue_run(void) __attribute__((weak));
+
+static void task_exit(void)
+{
+	_task_cur->state = TASK_DEAD;
+	for (;;) {
+		task_yield();
+	}
+}
+
+static void idle_entry(void *arg)
+{
+	(void)arg;
+
+	for (;;) {
+		__asm__ volatile ("wfi");
+	}
+}
+
+static void task_pend_switch(void)
+{
+	SCB_ICSR = SCB_ICSR_PENDSVSET;
+}
+
+/*
+ * Pick the task to run next: the highest priority ready one, starting the
+ * search after the current task so that equal priorities take turns.
+ * Called from the PendSV handler with the outgoing stack pointer saved.
+ * Deferred work, which shares PendSV, runs first so that the tasks it
+ * wakes are considered.
+ */
+__attribute__((used)) uint32_t *_task_switch(void)
+{
+	uint32_t primask;
+	struct task *start;
+	struct task *t;
+	struct task *best = &idle_task;
+
+	if (workqueue_run) {
+		workqueue_run();
+	}
+
+	primask = cm_critical_enter();
+	start = _task_cur ? _task_cur : task_list;
+	t = start;
+
+	do {
+		t = t->next ? t->next : task_list;
+		if ((t->state == TASK_READY) && (t->prio > best->prio)) {
+			best = t;
+		}
+	} while (t != start);
+
+	_task_cur = best;
+	cm_critical_exit(primask);
+
+	return best->sp;
+}
+
+void pend_sv_handler(void)
+{
+	__asm__ volatile (
+		"ldr	r3, =_task_cur\n"
+		"ldr	r2, [r3]\n"
+		"cbz	r2, 1f\n"		/* Nothing to save on start */
+		"mrs	r0, psp\n"
+		"isb\n"
+#if defined(__ARM_FP) && !defined(__SOFTFP__)
+		"tst	lr, #0x10\n"		/* Task has an FPU frame? */
+		"it	eq\n"
+		"vstmdbeq r0!, {s16-s31}\n"
+#endif
+		"stmdb	r0!, {r4-r11, lr}\n"
+		"str	r0, [r2]\n"
+		"1:\n"
+		"bl	_task_switch\n"
+		"ldmia	r0!, {r4-r11, lr}\n"
+#if defined(__ARM_FP) && !defined(__SOFTFP__)
+		"tst	lr, #0x10\n"
+		"it	eq\n"
+		"vldmiaeq r0!, {s16-s31}\n"
+#endif
+		"msr	psp, r0\n"
+		"isb\n"
+		"bx	lr\n"
+	);
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Create a task
+ *
+ * The task becomes ready at once, and runs from the next switch after
+ * task_start() has been called.
+ *
+ * @param[in] t Task control block, which must stay valid
+ * @param[in] entry Task function; returning from it ends the task
+ * @param[in] arg Argument passed to entry
+ * @param[in] stack Stack of the task, 8 byte aligned
+ * @param[in] stack_words Size of stack in words, at least @ref TASK_STACK_MIN
+ * @param[in] prio Priority, higher values run first. 0 is the idle priority.
+ */
+void task_create(struct task *t, void (*entry)(void *), void *arg,
+		 uint32_t *stack, uint32_t stack_words, uint8_t prio)
+{
+	uint32_t *sp = stack + (stack_words & ~1);
+	uint32_t primask;
+	int i;
+
+	/* Hardware frame: r0-r3, r12, lr, pc, xpsr */
+	*--sp = XPSR_T;
+	*--sp = (uint32_t)entry & ~1;
+	*--sp = (uint32_t)task_exit;
+	for (i = 0; i < 4; i++) {
+		*--sp = 0;
+	}
+	*--sp = (uint32_t)arg;
+
+	/* Software frame: r4-r11, EXC_RETURN */
+	*--sp = EXC_RETURN_THREAD_PSP;
+	for (i = 0; i < 8; i++) {
+		*--sp = 0;
+	}
+
+	t->sp = sp;
+	t->prio = prio;
+	t->state = TASK_READY;
+
+	primask = cm_critical_enter();
+	t->next = task_list;
+	task_list = t;
+	cm_critical_exit(primask);
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Start running tasks
+ *
+ * The calling context is abandoned, its stack is reused for handlers.
+ */
+void task_start(void)
+{
+	task_create(&idle_task, idle_entry, NULL, idle_stack,
+		    IDLE_STACK_WORDS, 0);
+
+	/* Switch only once no other handler is active. */
+	SCB_SHPR(SCB_SHPR_PRI_14_PENDSV) = 0xff;
+
+	_task_cur = NULL;
+	task_pend_switch();
+	cm_enable_interrupts();
+
+	for (;;) {
+		__wfe();
+	}
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Let other tasks of the same priority run */
+void task_yield(void)
+{
+	task_pend_switch();
+	__dsb();
+	__asm__ volatile ("isb");
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Put the current task to sleep
+ *
+ * @param[in] n Number of task_tick() calls to sleep for
+ */
+void task_sleep(uint32_t n)
+{
+	uint32_t primask = cm_critical_enter();
+
+	_task_cur->wake = ticks + n;
+	_task_cur->state = TASK_SLEEPING;
+	cm_critical_exit(primask);
+
+	task_yield();
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Stop a task from being scheduled until task_resume() */
+void task_suspend(struct task *t)
+{
+	t->state = TASK_SUSPENDED;
+	if (t == _task_cur) {
+		task_yield();
+	}
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Make a suspended or sleeping task ready again
+ *
+ * May be called from interrupt handlers.
+ */
+void task_resume(struct task *t)
+{
+	uint32_t primask = cm_critical_enter();
+
+	if (t->state != TASK_DEAD) {
+		t->state = TASK_READY;
+	}
+	cm_critical_exit(primask);
+
+	task_pend_switch();
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Advance the task tick
+ *
+ * Wakes sleeping tasks that are due and lets tasks of equal priority take
+ * turns. To be called from sys_tick_handler().
+ */
+void task_tick(void)
+{
+	uint32_t primask = cm_critical_enter();
+	struct task *t;
+
+	ticks++;
+	for (t = task_list; t; t = t->next) {
+		if ((t->state == TASK_SLEEPING) &&
+		    ((int32_t)(ticks - t->wake) >= 0)) {
+			t->state = TASK_READY;
+		}
+	}
+	cm_critical_exit(primask);
+
+	task_pend_switch();
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief The task that is running, NULL before task_start() */
+struct task *task_current(void)
+{
+	return _task_cur;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Number of task_tick() calls so far */
+uint32_t task_get_ticks(void)
+{
+	return ticks;
+}
+
+#endif
+
+/**@}*/
+
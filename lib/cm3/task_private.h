@@ -0,0 +1,31 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __TASK_PRIVATE_H
+#define __TASK_PRIVATE_H
+
+#include <libopencm3/cm3/task.h>
+
+/*
+ * Referenced from the PendSV handler's assembly by name, so external: link
+ * time optimization may rename static symbols. Not part of the API, hence
+ * the reserved names.
+ */
+extern struct task *_task_cur;
+uint32_t *_task_switch(void);
+
+#endif
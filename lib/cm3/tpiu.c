@@ -0,0 +1,58 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Those are defined only on CM3 or CM4 */
+#if defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__)
+
+#include <libopencm3/cm3/scs.h>
+#include <libopencm3/cm3/tpiu.h>
+
+/*---------------------------------------------------------------------------*/
+/** @brief TPIU Set up the single wire output
+ *
+ * Selects a one bit port with the given protocol and the formatter bypassed,
+ * so the SWO pin carries the ITM and DWT packets as they are. Parts may need
+ * further setup to route the trace clock and the pin, e.g. DBGMCU_CR on
+ * STM32.
+ *
+ * @param[in] traceclk Asynchronous reference clock of the TPIU in Hz,
+ * usually the core clock
+ * @param[in] baud Bit rate wanted
+ * @param[in] protocol @ref TPIU_SPPR_ASYNC_NRZ or
+ * @ref TPIU_SPPR_ASYNC_MANCHESTER
+ * @returns Bit rate set, which the receiver must match
+ */
+uint32_t tpiu_swo_setup(uint32_t traceclk, uint32_t baud, uint32_t protocol)
+{
+	uint32_t div = (traceclk + baud / 2) / baud;
+
+	if (div < 1) {
+		div = 1;
+	} else if (div > 0x10000) {
+		div = 0x10000;
+	}
+
+	SCS_DEMCR |= SCS_DEMCR_TRCENA;
+	TPIU_CSPSR = 1;
+	TPIU_SPPR = protocol;
+	TPIU_ACPR = div - 1;
+	TPIU_FFCR = TPIU_FFCR_TRIGIN;
+
+	return traceclk / div;
+}
+
+#endif
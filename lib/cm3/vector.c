@@ -32,9 +32,28 @@ extern funcp_t __preinit_array_start, __preinit_array_end;
 extern funcp_t __init_array_start, __init_array_end;
 extern funcp_t __fini_array_start, __fini_array_end;
 
+/* Set up by the generated linker script only, empty otherwise */
+struct init_copy {
+	const unsigned *load;
+	unsigned *start;
+	unsigned *end;
+};
+struct init_zero {
+	unsigned *start;
+	unsigned *end;
+};
+extern struct init_copy __copy_table_start[] __attribute__((weak));
+extern struct init_copy __copy_table_end[] __attribute__((weak));
+extern struct init_zero __zero_table_start[] __attribute__((weak));
+extern struct init_zero __zero_table_end[] __attribute__((weak));
+
 void main(void);
 void blocking_handler(void);
 void null_handler(void);
+void pend_sv_default_handler(void);
+
+/* Set when libopencm3/cm3/workqueue.h is in use */
+void workqueue_run(void) __attribute__((weak));
 
 __attribute__ ((section(".vectors")))
 vector_table_t vector_table = {
@@ -59,20 +78,74 @@ vector_table_t vector_table = {
 	}
 };
 
-void WEAK __attribute__ ((naked)) reset_handler(void)
+/*
+ * The linker scripts align both ends of .data and .bss to words, so the
+ * startup code moves four words per LDM/STM while it can, and single words
+ * for the rest. The rest goes through a volatile pointer to keep the
+ * compiler from turning it into a memcpy() or memset() call.
+ */
+static void __attribute__ ((noinline))
+reset_copy(unsigned *dest, const unsigned *src, const unsigned *end)
 {
-	volatile unsigned *src, *dest;
-	funcp_t *fp;
+	volatile unsigned *tail;
+
+	while (end - dest >= 4) {
+		__asm__ volatile ("ldmia %0!, {r2, r3, r4, r5}\n"
+				  "stmia %1!, {r2, r3, r4, r5}\n"
+				  : "+l" (src), "+l" (dest)
+				  :
+				  : "r2", "r3", "r4", "r5", "memory");
+	}
+
+	for (tail = dest; tail < end; tail++) {
+		*tail = *src++;
+	}
+}
+
+static void __attribute__ ((noinline))
+reset_zero(unsigned *dest, const unsigned *end)
+{
+	register unsigned z0 __asm__ ("r2") = 0;
+	register unsigned z1 __asm__ ("r3") = 0;
+	register unsigned z2 __asm__ ("r4") = 0;
+	register unsigned z3 __asm__ ("r5") = 0;
+	volatile unsigned *tail;
+
+	while (end - dest >= 4) {
+		__asm__ volatile ("stmia %0!, {%1, %2, %3, %4}\n"
+				  : "+l" (dest)
+				  : "l" (z0), "l" (z1), "l" (z2), "l" (z3)
+				  : "memory");
+	}
 
-	for (src = &_data_loadaddr, dest = &_data;
-		dest < &_edata;
-		src++, dest++) {
-		*dest = *src;
+	for (tail = dest; tail < end; tail++) {
+		*tail = 0;
 	}
+}
+
+static void __attribute__ ((noinline)) reset_init_memory(void)
+{
+	struct init_copy *cp;
+	struct init_zero *zp;
+
+	/* .bss follows .data, .noinit is after both and left alone. */
+	reset_copy(&_data, &_data_loadaddr, &_edata);
+	reset_zero(&_edata, &_ebss);
 
-	while (dest < &_ebss) {
-		*dest++ = 0;
+	/* Data in further memories, like CCM */
+	for (cp = __copy_table_start; cp < __copy_table_end; cp++) {
+		reset_copy(cp->start, cp->load, cp->end);
 	}
+	for (zp = __zero_table_start; zp < __zero_table_end; zp++) {
+		reset_zero(zp->start, zp->end);
+	}
+}
+
+void WEAK __attribute__ ((naked)) reset_handler(void)
+{
+	funcp_t *fp;
+
+	reset_init_memory();
 
 	/* might be provided by platform specific vector.c */
 	pre_main();
@@ -105,10 +178,17 @@ void null_handler(void)
 	/* Do nothing. */
 }
 
+void pend_sv_default_handler(void)
+{
+	if (workqueue_run) {
+		workqueue_run();
+	}
+}
+
 #pragma weak nmi_handler = null_handler
 #pragma weak hard_fault_handler = blocking_handler
 #pragma weak sv_call_handler = null_handler
-#pragma weak pend_sv_handler = null_handler
+#pragma weak pend_sv_handler = pend_sv_default_handler
 #pragma weak sys_tick_handler = null_handler
 
 /* Those are defined only on CM3 or CM4 */
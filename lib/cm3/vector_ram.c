@@ -0,0 +1,100 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stddef.h>
+#include <libopencm3/cm3/scb.h>
+#include <libopencm3/cm3/sync.h>
+#include <libopencm3/cm3/vector.h>
+
+/*
+ * The table is only linked in, and takes up RAM, when one of the functions
+ * below is used.
+ */
+static vector_table_t ram_vector_table
+	__attribute__((aligned(VECTOR_TABLE_ALIGN)));
+
+/*---------------------------------------------------------------------------*/
+/** @brief Move the vector table to RAM
+ *
+ * Copies the active vector table, which is the one in flash unless a boot
+ * loader has moved it, to a RAM table and points SCB_VTOR at that. Does
+ * nothing if that was done already. The core must implement SCB_VTOR, which
+ * Cortex-M0 does not.
+ *
+ * @returns true if the RAM table is active
+ */
+bool vector_table_relocate(void)
+{
+	vector_table_entry_t *dst = (vector_table_entry_t *)&ram_vector_table;
+	vector_table_entry_t *src;
+	uint32_t primask;
+	int i;
+
+	if (SCB_VTOR == (uint32_t)&ram_vector_table) {
+		return true;
+	}
+
+	primask = cm_critical_enter();
+
+	src = (vector_table_entry_t *)SCB_VTOR;
+	for (i = 0; i < VECTOR_TABLE_ENTRIES; i++) {
+		dst[i] = src[i];
+	}
+
+	__dsb();
+	SCB_VTOR = (uint32_t)&ram_vector_table;
+	__dsb();
+	__asm__ volatile ("isb");
+
+	cm_critical_exit(primask);
+
+	return SCB_VTOR == (uint32_t)&ram_vector_table;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Install an interrupt or exception handler
+ *
+ * Moves the vector table to RAM first if needed, see
+ * vector_table_relocate(). The new handler is called directly by the core,
+ * for interrupts raised after this returns.
+ *
+ * @param[in] irqn Interrupt number, NVIC_*_IRQ; the negative numbers of
+ * the system exceptions from NVIC_NMI_IRQ on are accepted as well
+ * @param[in] handler Handler to install
+ * @returns The handler installed before, NULL on bad irqn or if the table
+ * can not be moved
+ */
+vector_table_entry_t vector_set_handler(int irqn,
+					vector_table_entry_t handler)
+{
+	vector_table_entry_t *table = (vector_table_entry_t *)&ram_vector_table;
+	vector_table_entry_t old;
+
+	if ((irqn < NVIC_NMI_IRQ) || (irqn >= NVIC_IRQ_COUNT)) {
+		return NULL;
+	}
+
+	if (!vector_table_relocate()) {
+		return NULL;
+	}
+
+	old = table[16 + irqn];
+	table[16 + irqn] = handler;
+	__dsb();
+
+	return old;
+}
@@ -0,0 +1,93 @@
+/** @addtogroup CM3_workqueue_defines
+ *
+ * The queue holds pointers to work items. An item is queued at most once
+ * at a time: posting it again while it is pending does nothing, so the
+ * queue can not overflow as long as it has a slot for every item. The
+ * pending flag is cleared before the item runs, so it may post itself.
+ */
+
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <libopencm3/cm3/scb.h>
+#include <libopencm3/cm3/sync.h>
+#include <libopencm3/cm3/workqueue.h>
+
+/**@{*/
+
+static struct ring_mpmc queue;
+
+/*---------------------------------------------------------------------------*/
+/** @brief Set up the work queue
+ *
+ * Also gives PendSV the lowest priority, so that work never delays an
+ * interrupt handler.
+ *
+ * @param[in] slots Queue storage, which must stay valid
+ * @param[in] size Number of slots, a power of two
+ */
+void workqueue_init(struct ring_mpmc_slot *slots, uint32_t size)
+{
+	ring_mpmc_init(&queue, slots, size);
+
+	/* Word access, as ARMv6-M has no byte access to SHPR */
+	SCB_SHPR3 |= 0xff << 16;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Queue work to run from PendSV
+ *
+ * May be called from any context.
+ *
+ * @param[in] w Work item
+ * @returns false if w was pending already or the queue is full
+ */
+bool workqueue_post(struct work *w)
+{
+	if (!cm_atomic_cas(&w->pending, 0, 1)) {
+		return false;
+	}
+
+	if (!ring_mpmc_push(&queue, (uint32_t)w)) {
+		w->pending = 0;
+		return false;
+	}
+
+	SCB_ICSR = SCB_ICSR_PENDSVSET;
+
+	return true;
+}
+
+/*---------------------------------------------------------------------------*/
+/** @brief Run all queued work
+ *
+ * Called from the PendSV handler.
+ */
+void workqueue_run(void)
+{
+	struct work *w;
+	uint32_t val;
+
+	while (ring_mpmc_pop(&queue, &val)) {
+		w = (struct work *)val;
+		w->pending = 0;
+		__dmb();
+		w->func(w->arg);
+	}
+}
+
+/**@}*/
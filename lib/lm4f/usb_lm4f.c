@@ -189,7 +189,6 @@ static void lm4f_ep_setup(usbd_device *usbd_dev, uint8_t addr, uint8_t type,
 			  void (*callback) (usbd_device *usbd_dev, uint8_t ep))
 {
 	(void)usbd_dev;
-	(void)type;
 
 	uint8_t reg8;
 	uint16_t fifo_size;
@@ -197,6 +196,8 @@ static void lm4f_ep_setup(usbd_device *usbd_dev, uint8_t addr, uint8_t type,
 	const bool dir_tx = addr & 0x80;
 	const uint8_t ep = addr & 0x0f;
 
+	type &= USBD_EP_TYPE_MASK;
+
 	/*
 	 * We do not mess with the maximum packet size, but we can only allocate
 	 * the FIFO in power-of-two increments.
@@ -504,6 +505,12 @@ static void lm4f_poll(usbd_device *usbd_dev)
 				? USB_TRANSACTION_SETUP :
 				  USB_TRANSACTION_OUT;
 
+			if (type == USB_TRANSACTION_SETUP) {
+				usbd_dev->control_state.req_len =
+					lm4f_ep_read_packet(usbd_dev, 0,
+					&usbd_dev->control_state.req, 8);
+			}
+
 			if (usbd_dev->user_callback_ctr[0][type]) {
 				usbd_dev->
 					user_callback_ctr[0][type](usbd_dev, 0);
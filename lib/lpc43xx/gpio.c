@@ -36,17 +36,17 @@ LGPL License Terms @ref lgpl_license
 
 void gpio_set(uint32_t gpioport, uint32_t gpios)
 {
-	GPIO_SET(gpioport) = gpios;
+	gpio_fast_set(gpioport, gpios);
 }
 
 void gpio_clear(uint32_t gpioport, uint32_t gpios)
 {
-	GPIO_CLR(gpioport) = gpios;
+	gpio_fast_clear(gpioport, gpios);
 }
 
 void gpio_toggle(uint32_t gpioport, uint32_t gpios)
 {
-	GPIO_NOT(gpioport) = gpios;
+	gpio_fast_toggle(gpioport, gpios);
 }
 
 /**@}*/
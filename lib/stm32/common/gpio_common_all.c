@@ -41,7 +41,7 @@ Set one or more pins of the given GPIO port to 1 in an atomic operation.
 */
 void gpio_set(uint32_t gpioport, uint16_t gpios)
 {
-	GPIO_BSRR(gpioport) = gpios;
+	gpio_fast_set(gpioport, gpios);
 }
 
 /*---------------------------------------------------------------------------*/
@@ -56,7 +56,7 @@ Clear one or more pins of the given GPIO port to 0 in an atomic operation.
 */
 void  gpio_clear(uint32_t gpioport, uint16_t gpios)
 {
-	GPIO_BSRR(gpioport) = (gpios << 16);
+	gpio_fast_clear(gpioport, gpios);
 }
 
 /*---------------------------------------------------------------------------*/
@@ -71,7 +71,7 @@ void  gpio_clear(uint32_t gpioport, uint16_t gpios)
 */
 uint16_t gpio_get(uint32_t gpioport, uint16_t gpios)
 {
-	return gpio_port_read(gpioport) & gpios;
+	return gpio_fast_get(gpioport, gpios);
 }
 
 /*---------------------------------------------------------------------------*/
@@ -80,6 +80,8 @@ uint16_t gpio_get(uint32_t gpioport, uint16_t gpios)
 Toggle one or more pins of the given GPIO port. The toggling is not atomic, but
 the non-toggled pins are not affected.
 
+The gpio_fast_*() versions of these functions are inlined from gpio.h.
+
 @param[in] gpioport Unsigned int32. Port identifier @ref gpio_port_id
 @param[in] gpios Unsigned int16. Pin identifiers @ref gpio_pin_id
 	     If multiple pins are to be changed, use logical OR '|' to separate
@@ -87,8 +89,7 @@ the non-toggled pins are not affected.
 */
 void gpio_toggle(uint32_t gpioport, uint16_t gpios)
 {
-	uint32_t port = GPIO_ODR(gpioport);
-	GPIO_BSRR(gpioport) = ((port & gpios) << 16) | (~port & gpios);
+	gpio_fast_toggle(gpioport, gpios);
 }
 
 /*---------------------------------------------------------------------------*/
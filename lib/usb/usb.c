@@ -78,6 +78,7 @@ usbd_device *usbd_init(const usbd_driver *driver,
 	usbd_dev->num_strings = num_strings;
 	usbd_dev->ctrl_buf = control_buffer;
 	usbd_dev->ctrl_buf_len = control_buffer_size;
+	usbd_dev->poll_budget = USBD_POLL_BUDGET_DEFAULT;
 
 	usbd_dev->user_callback_ctr[0][USB_TRANSACTION_SETUP] =
 	    _usbd_control_setup;
@@ -111,10 +112,28 @@ void usbd_register_sof_callback(usbd_device *usbd_dev, void (*callback)(void))
 	usbd_dev->user_callback_sof = callback;
 }
 
+/**
+ * Set the number of endpoint events handled per call to usbd_poll().
+ *
+ * usbd_poll() services pending endpoint events in a loop, so a single
+ * interrupt can handle a burst of transactions. Lowering the budget bounds
+ * the time spent in the USB interrupt, at the cost of more interrupts.
+ * Events left over are handled by the next call.
+ *
+ * @param usbd_dev USB device handle
+ * @param budget Events per call, or 0 to restore the default of
+ *               USBD_POLL_BUDGET_DEFAULT
+ */
+void usbd_set_poll_budget(usbd_device *usbd_dev, uint8_t budget)
+{
+	usbd_dev->poll_budget = budget ? budget : USBD_POLL_BUDGET_DEFAULT;
+}
+
 void _usbd_reset(usbd_device *usbd_dev)
 {
 	usbd_dev->current_address = 0;
 	usbd_dev->current_config = 0;
+	_usbd_transfer_reset(usbd_dev);
 	usbd_ep_setup(usbd_dev, 0, USB_ENDPOINT_ATTR_CONTROL, 64, NULL);
 	usbd_dev->driver->set_address(usbd_dev, 0);
 
@@ -141,6 +160,8 @@ void usbd_ep_setup(usbd_device *usbd_dev, uint8_t addr, uint8_t type,
 		   uint16_t max_size,
 		   void (*callback)(usbd_device *usbd_dev, uint8_t ep))
 {
+	usbd_dev->ep_size[addr & 0x07][(addr & 0x80) ? USB_TRANSACTION_IN :
+				       USB_TRANSACTION_OUT] = max_size;
 	usbd_dev->driver->ep_setup(usbd_dev, addr, type, max_size, callback);
 }
 
@@ -0,0 +1,319 @@
+/** @defgroup usb_cdcacm_file Buffered CDC-ACM Function
+
+@ingroup USB
+
+@brief <b>Buffered CDC-ACM (virtual serial port) function</b>
+
+The CDC-ACM function moves data between two ring buffers and a pair of bulk
+endpoints. The application writes to and reads from the rings, the endpoint
+callbacks refill the IN endpoint from the transmit ring and drain the OUT
+endpoint into the receive ring. While the receive ring can not take another
+packet, the OUT endpoint is NAKed so the host holds back further data.
+
+Each ring has a single producer and a single consumer, which only ever move
+their own index. The endpoints are only touched from the USB context: data
+written while the IN endpoint is idle goes out on the next start of frame,
+and a NAKed OUT endpoint is released on the first start of frame after
+usb_cdcacm_read() made room. usb_cdcacm_write() and usb_cdcacm_read() may
+therefore run concurrently with usbd_poll(), e.g. from the main loop while
+it runs in the USB interrupt.
+
+LGPL License Terms @ref lgpl_license
+*/
+
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**@{*/
+
+#include <string.h>
+#include <libopencm3/cm3/common.h>
+#include <libopencm3/cm3/ring.h>
+#include <libopencm3/usb/usbd.h>
+#include <libopencm3/usb/cdc.h>
+#include "usb_private.h"
+
+struct _usbd_cdcacm {
+	usbd_device *usbd_dev;
+	uint8_t iface;
+	uint8_t ep_in;
+	uint8_t ep_out;
+	uint8_t ep_size;
+
+	struct ring_spsc tx;
+	struct ring_spsc rx;
+
+	/* Only touched from the USB context */
+	bool tx_busy;			/* A packet is queued on the IN endpoint */
+	bool tx_zlp;			/* Last packet was full size */
+	bool rx_nak;			/* OUT endpoint held off for lack of room */
+
+	void (*sof_next)(void);		/* SOF callback registered before ours */
+
+	struct usb_cdc_line_coding line_coding;
+	uint16_t line_state;		/* SET_CONTROL_LINE_STATE wValue */
+};
+
+static usbd_cdcacm _cdcacm;
+
+/*
+ * Queue the next packet on the IN endpoint. A transfer that ends on a full
+ * packet is terminated with a zero-length packet, so the host hands the data
+ * to the application without waiting for more.
+ */
+static void cdcacm_tx_kick(usbd_cdcacm *acm)
+{
+	uint8_t buf[64];
+	uint16_t len;
+
+	if (acm->tx_busy) {
+		return;
+	}
+
+	len = ring_spsc_peek(&acm->tx, buf, acm->ep_size);
+	if ((len == 0) && !acm->tx_zlp) {
+		return;
+	}
+
+	if ((usbd_ep_write_packet(acm->usbd_dev, acm->ep_in, buf, len) == 0) &&
+	    (len != 0)) {
+		return;
+	}
+
+	ring_spsc_skip(&acm->tx, len);
+	acm->tx_busy = true;
+	acm->tx_zlp = (len == acm->ep_size);
+}
+
+static void cdcacm_data_tx_cb(usbd_device *usbd_dev, uint8_t ep)
+{
+	usbd_cdcacm *acm = &_cdcacm;
+
+	(void)usbd_dev;
+	(void)ep;
+
+	acm->tx_busy = false;
+	cdcacm_tx_kick(acm);
+}
+
+static void cdcacm_data_rx_cb(usbd_device *usbd_dev, uint8_t ep)
+{
+	usbd_cdcacm *acm = &_cdcacm;
+	uint8_t buf[64];
+	uint16_t len;
+
+	/*
+	 * Hold off the host before reading if the ring might not take the
+	 * packet after this one. Reading re-enables reception unless NAK is
+	 * forced, so setting it afterwards could let one more packet in.
+	 */
+	if (ring_spsc_free(&acm->rx) < 2u * acm->ep_size) {
+		usbd_ep_nak_set(usbd_dev, ep, 1);
+		acm->rx_nak = true;
+	}
+
+	len = usbd_ep_read_packet(usbd_dev, ep, buf, sizeof(buf));
+	ring_spsc_write(&acm->rx, buf, len);
+}
+
+/*
+ * Once per frame: send what the application queued since the IN endpoint went
+ * idle, and let the host send again once the application made room.
+ */
+static void cdcacm_sof(void)
+{
+	usbd_cdcacm *acm = &_cdcacm;
+
+	if (acm->usbd_dev->current_config) {
+		cdcacm_tx_kick(acm);
+
+		if (acm->rx_nak &&
+		    (ring_spsc_free(&acm->rx) >= 2u * acm->ep_size)) {
+			acm->rx_nak = false;
+			usbd_ep_nak_set(acm->usbd_dev, acm->ep_out, 0);
+		}
+	}
+
+	if (acm->sof_next) {
+		acm->sof_next();
+	}
+}
+
+static int cdcacm_control_request(usbd_device *usbd_dev,
+				  struct usb_setup_data *req, uint8_t **buf,
+				  uint16_t *len,
+				  void (**complete)(usbd_device *usbd_dev,
+						    struct usb_setup_data *req))
+{
+	usbd_cdcacm *acm = &_cdcacm;
+
+	(void)complete;
+	(void)usbd_dev;
+
+	/* Requests to other interfaces, e.g. of a second function */
+	if (req->wIndex != acm->iface) {
+		return USBD_REQ_NEXT_CALLBACK;
+	}
+
+	switch (req->bRequest) {
+	case USB_CDC_REQ_SET_CONTROL_LINE_STATE:
+		acm->line_state = req->wValue;
+		return USBD_REQ_HANDLED;
+	case USB_CDC_REQ_SET_LINE_CODING:
+		if (*len < sizeof(struct usb_cdc_line_coding)) {
+			return USBD_REQ_NOTSUPP;
+		}
+		memcpy(&acm->line_coding, *buf,
+		       sizeof(struct usb_cdc_line_coding));
+		return USBD_REQ_HANDLED;
+	case USB_CDC_REQ_GET_LINE_CODING:
+		*buf = (uint8_t *)&acm->line_coding;
+		*len = sizeof(struct usb_cdc_line_coding);
+		return USBD_REQ_HANDLED;
+	}
+
+	return USBD_REQ_NOTSUPP;
+}
+
+static void cdcacm_set_config(usbd_device *usbd_dev, uint16_t wValue)
+{
+	usbd_cdcacm *acm = &_cdcacm;
+
+	(void)wValue;
+
+	acm->tx_busy = false;
+	acm->tx_zlp = false;
+	acm->rx_nak = false;
+
+	usbd_ep_setup(usbd_dev, acm->ep_in, USB_ENDPOINT_ATTR_BULK,
+		      acm->ep_size, cdcacm_data_tx_cb);
+	usbd_ep_setup(usbd_dev, acm->ep_out, USB_ENDPOINT_ATTR_BULK,
+		      acm->ep_size, cdcacm_data_rx_cb);
+
+	usbd_register_control_callback(
+				usbd_dev,
+				USB_REQ_TYPE_CLASS | USB_REQ_TYPE_INTERFACE,
+				USB_REQ_TYPE_TYPE | USB_REQ_TYPE_RECIPIENT,
+				cdcacm_control_request);
+
+	/* Data written before the host configured the device */
+	cdcacm_tx_kick(acm);
+}
+
+/** @brief Initializes the buffered CDC-ACM function.
+
+The descriptors of the communication and data interfaces are provided by the
+application as usual. The notification endpoint, if any, is left to it too.
+
+Pending data is passed on from the start of frame callback, which this
+function registers. An application SOF callback must be registered before
+calling it, it is chained. On the STM32F103 in interrupt mode, enable the SOF
+interrupt (USB_CNTR_SOFM) as well.
+
+@param[in] usbd_dev The USB device to associate the function with.
+@param[in] iface The number of the communication interface, to which the
+		host sends the class requests.
+@param[in] ep_in The bulk IN endpoint address of the data interface.
+@param[in] ep_out The bulk OUT endpoint address of the data interface.
+@param[in] ep_size The packet size of both endpoints, at most 64.
+@param[in] tx_buf Transmit ring buffer.
+@param[in] tx_size Size of tx_buf, a power of two.
+@param[in] rx_buf Receive ring buffer.
+@param[in] rx_size Size of rx_buf, a power of two of at least twice
+		ep_size.
+@return Pointer to the usbd_cdcacm struct.
+*/
+usbd_cdcacm *usb_cdcacm_init(usbd_device *usbd_dev, uint8_t iface,
+			     uint8_t ep_in, uint8_t ep_out, uint8_t ep_size,
+			     uint8_t *tx_buf, uint16_t tx_size,
+			     uint8_t *rx_buf, uint16_t rx_size)
+{
+	usbd_cdcacm *acm = &_cdcacm;
+
+	memset(acm, 0, sizeof(*acm));
+	acm->usbd_dev = usbd_dev;
+	acm->iface = iface;
+	acm->ep_in = ep_in;
+	acm->ep_out = ep_out;
+	acm->ep_size = MIN(ep_size, 64);
+	ring_spsc_init(&acm->tx, tx_buf, tx_size);
+	ring_spsc_init(&acm->rx, rx_buf, rx_size);
+
+	acm->line_coding.dwDTERate = 115200;
+	acm->line_coding.bCharFormat = USB_CDC_1_STOP_BITS;
+	acm->line_coding.bParityType = USB_CDC_NO_PARITY;
+	acm->line_coding.bDataBits = 8;
+
+	usbd_register_set_config_callback(usbd_dev, cdcacm_set_config);
+
+	acm->sof_next = usbd_dev->user_callback_sof;
+	usbd_register_sof_callback(usbd_dev, cdcacm_sof);
+
+	return acm;
+}
+
+/** @brief Queue data for transmission to the host.
+
+@param[in] acm The CDC-ACM function.
+@param[in] buf Data to send.
+@param[in] len Number of bytes in buf.
+@return Number of bytes queued, less than len if the transmit ring is full.
+*/
+uint16_t usb_cdcacm_write(usbd_cdcacm *acm, const void *buf, uint16_t len)
+{
+	return ring_spsc_write(&acm->tx, buf, len);
+}
+
+/** @brief Take received data out of the receive ring.
+
+@param[in] acm The CDC-ACM function.
+@param[out] buf Buffer for the data.
+@param[in] len Size of buf.
+@return Number of bytes copied to buf.
+*/
+uint16_t usb_cdcacm_read(usbd_cdcacm *acm, void *buf, uint16_t len)
+{
+	return ring_spsc_read(&acm->rx, buf, len);
+}
+
+/** @brief Bytes waiting in the receive ring. */
+uint16_t usb_cdcacm_rx_available(usbd_cdcacm *acm)
+{
+	return ring_spsc_used(&acm->rx);
+}
+
+/** @brief Room left in the transmit ring. */
+uint16_t usb_cdcacm_tx_free(usbd_cdcacm *acm)
+{
+	return ring_spsc_free(&acm->tx);
+}
+
+/** @brief Line coding last set by the host. */
+const struct usb_cdc_line_coding *usb_cdcacm_get_line_coding(
+		usbd_cdcacm *acm)
+{
+	return &acm->line_coding;
+}
+
+/** @brief Control line state (DTR in bit 0, RTS in bit 1) set by the host. */
+uint16_t usb_cdcacm_get_line_state(usbd_cdcacm *acm)
+{
+	return acm->line_state;
+}
+
+/**@}*/
+
@@ -73,25 +73,35 @@ int usbd_register_control_callback(usbd_device *usbd_dev, uint8_t type,
 
 static void usb_control_send_chunk(usbd_device *usbd_dev)
 {
+	const uint8_t *buf = usbd_dev->control_state.ctrl_const_buf;
+
+	if (!buf) {
+		buf = usbd_dev->control_state.ctrl_buf;
+	}
+
 	if (usbd_dev->desc->bMaxPacketSize0 <
 			usbd_dev->control_state.ctrl_len) {
 		/* Data stage, normal transmission */
-		usbd_ep_write_packet(usbd_dev, 0,
-				     usbd_dev->control_state.ctrl_buf,
+		usbd_ep_write_packet(usbd_dev, 0, buf,
 				     usbd_dev->desc->bMaxPacketSize0);
 		usbd_dev->control_state.state = DATA_IN;
-		usbd_dev->control_state.ctrl_buf +=
-			usbd_dev->desc->bMaxPacketSize0;
+		if (usbd_dev->control_state.ctrl_const_buf) {
+			usbd_dev->control_state.ctrl_const_buf +=
+				usbd_dev->desc->bMaxPacketSize0;
+		} else {
+			usbd_dev->control_state.ctrl_buf +=
+				usbd_dev->desc->bMaxPacketSize0;
+		}
 		usbd_dev->control_state.ctrl_len -=
 			usbd_dev->desc->bMaxPacketSize0;
 	} else {
 		/* Data stage, end of transmission */
-		usbd_ep_write_packet(usbd_dev, 0,
-				     usbd_dev->control_state.ctrl_buf,
+		usbd_ep_write_packet(usbd_dev, 0, buf,
 				     usbd_dev->control_state.ctrl_len);
 		usbd_dev->control_state.state = LAST_DATA_IN;
 		usbd_dev->control_state.ctrl_len = 0;
 		usbd_dev->control_state.ctrl_buf = NULL;
+		usbd_dev->control_state.ctrl_const_buf = NULL;
 	}
 }
 
@@ -150,6 +160,7 @@ static void usb_control_setup_read(usbd_device *usbd_dev,
 		struct usb_setup_data *req)
 {
 	usbd_dev->control_state.ctrl_buf = usbd_dev->ctrl_buf;
+	usbd_dev->control_state.ctrl_const_buf = NULL;
 	usbd_dev->control_state.ctrl_len = req->wLength;
 
 	if (usb_control_request_dispatch(usbd_dev, req)) {
@@ -196,7 +207,12 @@ void _usbd_control_setup(usbd_device *usbd_dev, uint8_t ea)
 
 	usbd_dev->control_state.complete = NULL;
 
-	if (usbd_ep_read_packet(usbd_dev, 0, req, 8) != 8) {
+	/*
+	 * The driver has already read the SETUP packet into req, so the
+	 * request can be processed whenever the hardware reports the SETUP
+	 * stage as complete. A packet shorter than 8 bytes is not a request.
+	 */
+	if (usbd_dev->control_state.req_len != 8) {
 		stall_transaction(usbd_dev);
 		return;
 	}
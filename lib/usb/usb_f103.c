@@ -18,6 +18,7 @@
  */
 
 #include <libopencm3/cm3/common.h>
+#include <libopencm3/cm3/sync.h>
 #include <libopencm3/stm32/rcc.h>
 #include <libopencm3/stm32/tools.h>
 #include <libopencm3/stm32/usb.h>
@@ -43,6 +44,10 @@ static uint16_t stm32f103_ep_read_packet(usbd_device *usbd_dev, uint8_t addr,
 static void stm32f103_poll(usbd_device *usbd_dev);
 
 static uint8_t force_nak[8];
+/* Endpoints configured with USBD_EP_DOUBLEBUF. */
+static uint8_t doublebuf[8];
+/* Double-buffered IN endpoints with a packet queued behind the active one. */
+static uint8_t doublebuf_tx_pending[8];
 static struct _usbd_device usbd_dev;
 
 const struct _usbd_driver stm32f103_usb_driver = {
@@ -80,24 +85,92 @@ static void stm32f103_set_address(usbd_device *dev, uint8_t addr)
 }
 
 /**
- * Set the receive buffer size for a given USB endpoint.
+ * Encode a receive buffer size for the COUNTn_RX buffer descriptor field.
  *
- * @param ep Index of endpoint to configure.
  * @param size Size in bytes of the RX buffer.
+ * @return Value for the BL_SIZE and NUM_BLOCK bits.
  */
-static void usb_set_ep_rx_bufsize(usbd_device *dev, uint8_t ep, uint32_t size)
+static uint16_t usb_rx_bufsize(uint32_t size)
 {
-	(void)dev;
 	if (size > 62) {
 		if (size & 0x1f) {
 			size -= 32;
 		}
-		USB_SET_EP_RX_COUNT(ep, (size << 5) | 0x8000);
+		return (size << 5) | 0x8000;
 	} else {
 		if (size & 1) {
 			size++;
 		}
-		USB_SET_EP_RX_COUNT(ep, size << 10);
+		return size << 10;
+	}
+}
+
+/**
+ * Set the receive buffer size for a given USB endpoint.
+ *
+ * @param ep Index of endpoint to configure.
+ * @param size Size in bytes of the RX buffer.
+ */
+static void usb_set_ep_rx_bufsize(usbd_device *dev, uint8_t ep, uint32_t size)
+{
+	(void)dev;
+	USB_SET_EP_RX_COUNT(ep, usb_rx_bufsize(size));
+}
+
+/**
+ * Set up a double-buffered bulk or isochronous endpoint.
+ *
+ * Both buffer descriptor slots are used for the single direction of the
+ * endpoint, so two buffers of max_size are reserved in packet memory.
+ * Bulk endpoints are flow controlled by the DTOG/SW_BUF pair: the hardware
+ * works on the buffer selected by DTOG, the application owns the one
+ * selected by SW_BUF and the endpoint NAKs while both select the same one.
+ * Isochronous endpoints simply swap buffers every frame.
+ */
+static void stm32f103_ep_setup_doublebuf(usbd_device *dev, uint8_t addr,
+					 uint8_t dir, uint8_t type,
+					 uint16_t max_size,
+					 void (*callback) (usbd_device *usbd_dev,
+							   uint8_t ep))
+{
+	doublebuf[addr] = 1;
+	doublebuf_tx_pending[addr] = 0;
+
+	if (type == USB_ENDPOINT_ATTR_BULK) {
+		USB_SET_EP_KIND(addr);
+	}
+
+	USB_SET_EP_TX_ADDR(addr, dev->pm_top);
+	dev->pm_top += max_size;
+	USB_SET_EP_RX_ADDR(addr, dev->pm_top);
+	dev->pm_top += max_size;
+
+	USB_CLR_EP_TX_DTOG(addr);
+	USB_CLR_EP_RX_DTOG(addr);
+
+	if (dir) {
+		USB_SET_EP_TX_COUNT(addr, 0);
+		USB_SET_EP_RX_COUNT(addr, 0);
+		if (callback) {
+			dev->user_callback_ctr[addr][USB_TRANSACTION_IN] =
+			    (void *)callback;
+		}
+		/* DTOG == SW_BUF, both buffers belong to the application. */
+		USB_SET_EP_RX_STAT(addr, USB_EP_RX_STAT_DISABLED);
+		USB_SET_EP_TX_STAT(addr, USB_EP_TX_STAT_VALID);
+	} else {
+		USB_SET_EP_TX_COUNT(addr, usb_rx_bufsize(max_size));
+		USB_SET_EP_RX_COUNT(addr, usb_rx_bufsize(max_size));
+		if (callback) {
+			dev->user_callback_ctr[addr][USB_TRANSACTION_OUT] =
+			    (void *)callback;
+		}
+		if (type == USB_ENDPOINT_ATTR_BULK) {
+			/* Hardware receives into buffer 0 first. */
+			USB_TOG_EP_TX_DTOG(addr);
+		}
+		USB_SET_EP_TX_STAT(addr, USB_EP_TX_STAT_DISABLED);
+		USB_SET_EP_RX_STAT(addr, USB_EP_RX_STAT_VALID);
 	}
 }
 
@@ -114,12 +187,26 @@ static void stm32f103_ep_setup(usbd_device *dev, uint8_t addr, uint8_t type,
 		[USB_ENDPOINT_ATTR_INTERRUPT] = USB_EP_TYPE_INTERRUPT,
 	};
 	uint8_t dir = addr & 0x80;
+	bool dbl = type & USBD_EP_DOUBLEBUF;
 	addr &= 0x7f;
+	type &= USBD_EP_TYPE_MASK;
 
 	/* Assign address. */
 	USB_SET_EP_ADDR(addr, addr);
 	USB_SET_EP_TYPE(addr, typelookup[type]);
 
+	if (dbl && (addr != 0) && ((type == USB_ENDPOINT_ATTR_BULK) ||
+				   (type == USB_ENDPOINT_ATTR_ISOCHRONOUS))) {
+		stm32f103_ep_setup_doublebuf(dev, addr, dir, type, max_size,
+					     callback);
+		return;
+	}
+
+	doublebuf[addr] = 0;
+	if (type == USB_ENDPOINT_ATTR_BULK) {
+		USB_CLR_EP_KIND(addr);
+	}
+
 	if (dir || (addr == 0)) {
 		USB_SET_EP_TX_ADDR(addr, dev->pm_top);
 		if (callback) {
@@ -152,6 +239,8 @@ static void stm32f103_endpoints_reset(usbd_device *dev)
 	for (i = 1; i < 8; i++) {
 		USB_SET_EP_TX_STAT(i, USB_EP_TX_STAT_DISABLED);
 		USB_SET_EP_RX_STAT(i, USB_EP_RX_STAT_DISABLED);
+		doublebuf[i] = 0;
+		doublebuf_tx_pending[i] = 0;
 	}
 	dev->pm_top = 0x40 + (2 * dev->desc->bMaxPacketSize0);
 }
@@ -174,11 +263,21 @@ static void stm32f103_ep_stall_set(usbd_device *dev, uint8_t addr,
 		/* Reset to DATA0 if clearing stall condition. */
 		if (!stall) {
 			USB_CLR_EP_TX_DTOG(addr);
+			if (doublebuf[addr]) {
+				/* Drop queued data, SW_BUF follows DTOG. */
+				USB_CLR_EP_RX_DTOG(addr);
+				doublebuf_tx_pending[addr] = 0;
+			}
 		}
 	} else {
 		/* Reset to DATA0 if clearing stall condition. */
 		if (!stall) {
 			USB_CLR_EP_RX_DTOG(addr);
+			if (doublebuf[addr] &&
+			    !(*USB_EP_REG(addr) & USB_EP_RX_SW_BUF)) {
+				/* Receive into buffer 0 again. */
+				USB_TOG_EP_TX_DTOG(addr);
+			}
 		}
 
 		USB_SET_EP_RX_STAT(addr, stall ? USB_EP_RX_STAT_STALL :
@@ -223,26 +322,124 @@ static void stm32f103_ep_nak_set(usbd_device *dev, uint8_t addr, uint8_t nak)
 /**
  * Copy a data buffer to packet memory.
  *
+ * Packet memory holds one halfword per 32-bit word. Word aligned buffers are
+ * read a word at a time, four words per iteration, other buffers fall back to
+ * halfword or byte reads so that no unaligned access is made.
+ *
  * @param vPM Destination pointer into packet memory.
  * @param buf Source pointer to data buffer.
  * @param len Number of bytes to copy.
  */
 static void usb_copy_to_pm(volatile void *vPM, const void *buf, uint16_t len)
 {
-	const uint16_t *lbuf = buf;
 	volatile uint16_t *PM = vPM;
+	uint16_t n = len >> 1;
+
+	if (((uintptr_t)buf & 3) == 0) {
+		const uint32_t *buf32 = buf;
+		uint32_t w0, w1, w2, w3;
+
+		for (; n >= 8; n -= 8, PM += 16) {
+			w0 = buf32[0];
+			w1 = buf32[1];
+			w2 = buf32[2];
+			w3 = buf32[3];
+			buf32 += 4;
+			PM[0] = w0;
+			PM[2] = w0 >> 16;
+			PM[4] = w1;
+			PM[6] = w1 >> 16;
+			PM[8] = w2;
+			PM[10] = w2 >> 16;
+			PM[12] = w3;
+			PM[14] = w3 >> 16;
+		}
+		for (; n >= 2; n -= 2, PM += 4) {
+			w0 = *buf32++;
+			PM[0] = w0;
+			PM[2] = w0 >> 16;
+		}
+		buf = buf32;
+	}
+
+	if (((uintptr_t)buf & 1) == 0) {
+		const uint16_t *buf16 = buf;
+
+		for (; n; n--, PM += 2) {
+			*PM = *buf16++;
+		}
+		buf = buf16;
+	} else {
+		const uint8_t *buf8 = buf;
+
+		for (; n; n--, PM += 2, buf8 += 2) {
+			*PM = buf8[0] | (buf8[1] << 8);
+		}
+		buf = buf8;
+	}
 
-	for (len = (len + 1) >> 1; len; PM += 2, lbuf++, len--) {
-		*PM = *lbuf;
+	if (len & 1) {
+		*PM = *(const uint8_t *)buf;
 	}
 }
 
+/**
+ * Queue a packet on a double-buffered IN endpoint.
+ *
+ * Bulk packets are written to the buffer selected by SW_BUF. If the hardware
+ * is idle the buffer is handed over immediately, otherwise it is handed over
+ * from stm32f103_poll() once the packet in flight has been sent.
+ */
+static uint16_t usb_doublebuf_write_packet(uint8_t ep, const void *buf,
+					   uint16_t len)
+{
+	uint16_t reg16 = *USB_EP_REG(ep);
+	uint8_t hw = (reg16 & USB_EP_TX_DTOG) ? 1 : 0;
+	uint8_t sw = (reg16 & USB_EP_TX_SW_BUF) ? 1 : 0;
+	uint32_t primask;
+
+	if ((reg16 & USB_EP_TYPE) == USB_EP_TYPE_ISO) {
+		/* Fill the buffer that is not sent in the current frame. */
+		usb_copy_to_pm(USB_GET_EP_DBUF_BUFF(ep, !hw), buf, len);
+		USB_SET_EP_DBUF_COUNT(ep, !hw, len);
+		return len;
+	}
+
+	if (doublebuf_tx_pending[ep]) {
+		return 0;
+	}
+
+	/* Nothing but this function moves SW_BUF while nothing is pending. */
+	usb_copy_to_pm(USB_GET_EP_DBUF_BUFF(ep, sw), buf, len);
+	USB_SET_EP_DBUF_COUNT(ep, sw, len);
+
+	/*
+	 * The packet in flight may complete at any time. Decide with the USB
+	 * interrupt held off, so that either the buffer is handed over here
+	 * or stm32f103_ctr() sees it pending.
+	 */
+	primask = cm_critical_enter();
+	hw = (*USB_EP_REG(ep) & USB_EP_TX_DTOG) ? 1 : 0;
+	if (hw == sw) {
+		USB_TOG_EP_RX_DTOG(ep);
+	} else {
+		doublebuf_tx_pending[ep] = 1;
+	}
+	cm_critical_exit(primask);
+
+	return len;
+}
+
 static uint16_t stm32f103_ep_write_packet(usbd_device *dev, uint8_t addr,
 				     const void *buf, uint16_t len)
 {
 	(void)dev;
 	addr &= 0x7F;
 
+	if (doublebuf[addr]) {
+		return usb_doublebuf_write_packet(addr, buf, len);
+	}
+
 	if ((*USB_EP_REG(addr) & USB_EP_TX_STAT) == USB_EP_TX_STAT_VALID) {
 		return 0;
 	}
@@ -257,29 +454,95 @@ static uint16_t stm32f103_ep_write_packet(usbd_device *dev, uint8_t addr,
 /**
  * Copy a data buffer from packet memory.
  *
- * @param buf Source pointer to data buffer.
- * @param vPM Destination pointer into packet memory.
+ * The counterpart of usb_copy_to_pm(), combining halfword pairs into word
+ * writes when the destination is word aligned.
+ *
+ * @param buf Destination pointer to data buffer.
+ * @param vPM Source pointer into packet memory.
  * @param len Number of bytes to copy.
  */
 static void usb_copy_from_pm(void *buf, const volatile void *vPM, uint16_t len)
 {
-	uint16_t *lbuf = buf;
 	const volatile uint16_t *PM = vPM;
-	uint8_t odd = len & 1;
+	uint16_t n = len >> 1;
+
+	if (((uintptr_t)buf & 3) == 0) {
+		uint32_t *buf32 = buf;
+
+		for (; n >= 8; n -= 8, PM += 16) {
+			buf32[0] = PM[0] | ((uint32_t)PM[2] << 16);
+			buf32[1] = PM[4] | ((uint32_t)PM[6] << 16);
+			buf32[2] = PM[8] | ((uint32_t)PM[10] << 16);
+			buf32[3] = PM[12] | ((uint32_t)PM[14] << 16);
+			buf32 += 4;
+		}
+		for (; n >= 2; n -= 2, PM += 4) {
+			*buf32++ = PM[0] | ((uint32_t)PM[2] << 16);
+		}
+		buf = buf32;
+	}
+
+	if (((uintptr_t)buf & 1) == 0) {
+		uint16_t *buf16 = buf;
+
+		for (; n; n--, PM += 2) {
+			*buf16++ = *PM;
+		}
+		buf = buf16;
+	} else {
+		uint8_t *buf8 = buf;
+		uint16_t h;
+
+		for (; n; n--, PM += 2) {
+			h = *PM;
+			*buf8++ = h;
+			*buf8++ = h >> 8;
+		}
+		buf = buf8;
+	}
 
-	for (len >>= 1; len; PM += 2, lbuf++, len--) {
-		*lbuf = *PM;
+	if (len & 1) {
+		*(uint8_t *)buf = *PM;
 	}
+}
+
+/**
+ * Read a packet from a double-buffered OUT endpoint.
+ *
+ * The filled buffer is released to the hardware before it is copied out,
+ * so the host can already send the next packet into the other buffer.
+ */
+static uint16_t usb_doublebuf_read_packet(uint8_t ep, void *buf, uint16_t len)
+{
+	uint16_t reg16 = *USB_EP_REG(ep);
+	uint8_t hw = (reg16 & USB_EP_RX_DTOG) ? 1 : 0;
+	uint8_t sw = (reg16 & USB_EP_RX_SW_BUF) ? 1 : 0;
 
-	if (odd) {
-		*(uint8_t *) lbuf = *(uint8_t *) PM;
+	if ((reg16 & USB_EP_TYPE) == USB_EP_TYPE_ISO) {
+		/* The buffer filled last frame is the one not in use now. */
+		USB_CLR_EP_RX_CTR(ep);
+	} else {
+		if (hw != sw) {
+			return 0;
+		}
+		USB_CLR_EP_RX_CTR(ep);
+		USB_TOG_EP_TX_DTOG(ep);
 	}
+
+	len = MIN(USB_GET_EP_DBUF_COUNT(ep, !hw) & 0x3ff, len);
+	usb_copy_from_pm(buf, USB_GET_EP_DBUF_BUFF(ep, !hw), len);
+
+	return len;
 }
 
 static uint16_t stm32f103_ep_read_packet(usbd_device *dev, uint8_t addr,
 					 void *buf, uint16_t len)
 {
 	(void)dev;
+	if (doublebuf[addr]) {
+		return usb_doublebuf_read_packet(addr, buf, len);
+	}
+
 	if ((*USB_EP_REG(addr) & USB_EP_RX_STAT) == USB_EP_RX_STAT_VALID) {
 		return 0;
 	}
@@ -295,9 +558,39 @@ static uint16_t stm32f103_ep_read_packet(usbd_device *dev, uint8_t addr,
 	return len;
 }
 
+/** Handle the correct transfer event reported in ISTR. */
+static void stm32f103_ctr(usbd_device *dev, uint16_t istr)
+{
+	uint8_t ep = istr & USB_ISTR_EP_ID;
+	uint8_t type = (istr & USB_ISTR_DIR) ? 1 : 0;
+
+	if (type) { /* OUT or SETUP transaction */
+		type += (*USB_EP_REG(ep) & USB_EP_SETUP) ? 1 : 0;
+	} else { /* IN transaction */
+		USB_CLR_EP_TX_CTR(ep);
+		if (doublebuf_tx_pending[ep]) {
+			/* Hand the queued buffer to the hardware. */
+			doublebuf_tx_pending[ep] = 0;
+			USB_TOG_EP_RX_DTOG(ep);
+		}
+	}
+
+	if (type == USB_TRANSACTION_SETUP) {
+		dev->control_state.req_len = stm32f103_ep_read_packet(dev, ep,
+					&dev->control_state.req, 8);
+	}
+
+	if (dev->user_callback_ctr[ep][type]) {
+		dev->user_callback_ctr[ep][type] (dev, ep);
+	} else {
+		USB_CLR_EP_RX_CTR(ep);
+	}
+}
+
 static void stm32f103_poll(usbd_device *dev)
 {
 	uint16_t istr = *USB_ISTR_REG;
+	uint8_t budget;
 
 	if (istr & USB_ISTR_RESET) {
 		dev->pm_top = 0x40;
@@ -306,21 +599,16 @@ static void stm32f103_poll(usbd_device *dev)
 		return;
 	}
 
-	if (istr & USB_ISTR_CTR) {
-		uint8_t ep = istr & USB_ISTR_EP_ID;
-		uint8_t type = (istr & USB_ISTR_DIR) ? 1 : 0;
-
-		if (type) { /* OUT or SETUP transaction */
-			type += (*USB_EP_REG(ep) & USB_EP_SETUP) ? 1 : 0;
-		} else { /* IN transaction */
-			USB_CLR_EP_TX_CTR(ep);
-		}
-
-		if (dev->user_callback_ctr[ep][type]) {
-			dev->user_callback_ctr[ep][type] (dev, ep);
-		} else {
-			USB_CLR_EP_RX_CTR(ep);
-		}
+	/*
+	 * ISTR reports one endpoint at a time, in priority order, and moves
+	 * on to the next one once the CTR bits of the current one are
+	 * cleared. Keep going until no endpoint is left or the budget is
+	 * spent.
+	 */
+	for (budget = dev->poll_budget;
+	     budget && (istr & USB_ISTR_CTR); budget--) {
+		stm32f103_ctr(dev, istr);
+		istr = *USB_ISTR_REG;
 	}
 
 	if (istr & USB_ISTR_SUSP) {
@@ -42,6 +42,7 @@ const struct _usbd_driver stm32f207_usb_driver = {
 	.ep_nak_set = stm32fx07_ep_nak_set,
 	.ep_write_packet = stm32fx07_ep_write_packet,
 	.ep_read_packet = stm32fx07_ep_read_packet,
+	.ep_transfer_in = stm32fx07_ep_transfer_in,
 	.poll = stm32fx07_poll,
 	.disconnect = stm32fx07_disconnect,
 	.base_address = USB_OTG_HS_BASE,
@@ -48,6 +48,7 @@ void stm32fx07_ep_setup(usbd_device *usbd_dev, uint8_t addr, uint8_t type,
 	 */
 	uint8_t dir = addr & 0x80;
 	addr &= 0x7f;
+	type &= USBD_EP_TYPE_MASK;
 
 	if (addr == 0) { /* For the default control endpoint */
 		/* Configure IN part. */
@@ -205,6 +206,71 @@ uint16_t stm32fx07_ep_write_packet(usbd_device *usbd_dev, uint8_t addr,
 	return len;
 }
 
+/*
+ * Push as many whole packets of an IN transfer into the endpoint TX FIFO as
+ * there is room for. The TXFE interrupt is kept unmasked while data remains.
+ */
+static void stm32fx07_ep_transfer_fill(usbd_device *usbd_dev, uint8_t ep,
+				       struct usbd_transfer *xfer)
+{
+	uint16_t mps = REBASE(OTG_DIEPCTL(ep)) & OTG_FS_DIEPCTLX_MPSIZ_MASK;
+	volatile uint32_t *fifo = REBASE_FIFO(ep);
+	uint8_t *buf = xfer->buf;
+
+	while (xfer->queued < xfer->len) {
+		uint16_t len = MIN(mps, xfer->len - xfer->queued);
+		const uint32_t *buf32 = (const uint32_t *)(buf + xfer->queued);
+		int i;
+
+		if ((REBASE(OTG_DTXFSTS(ep)) & OTG_FS_DTXFSTS_INEPTFSAV_MASK) <
+		    (uint32_t)((len + 3) / 4)) {
+			break;
+		}
+
+		for (i = len; i > 0; i -= 4) {
+			*fifo = *buf32++;
+		}
+		xfer->queued += len;
+	}
+
+	if (xfer->queued < xfer->len) {
+		REBASE(OTG_DIEPEMPMSK) |= 1 << ep;
+	} else {
+		REBASE(OTG_DIEPEMPMSK) &= ~(1 << ep);
+	}
+}
+
+/*
+ * Program a whole IN transfer into DIEPTSIZ, so the core only raises XFRC
+ * after the last packet has been sent.
+ */
+int stm32fx07_ep_transfer_in(usbd_device *usbd_dev, uint8_t ep,
+			     struct usbd_transfer *xfer)
+{
+	uint16_t mps = REBASE(OTG_DIEPCTL(ep)) & OTG_FS_DIEPCTLX_MPSIZ_MASK;
+	uint32_t pktcnt = (xfer->len + mps - 1) / mps;
+
+	/* Too many packets for PKTCNT, send it packet by packet instead. */
+	if (pktcnt > (OTG_FS_DIEPSIZX_PKTCNT_MASK >>
+		      OTG_FS_DIEPSIZX_PKTCNT_SHIFT)) {
+		return 1;
+	}
+
+	/* Return if endpoint is already enabled. */
+	if (REBASE(OTG_DIEPTSIZ(ep)) & OTG_FS_DIEPSIZX_PKTCNT_MASK) {
+		return -1;
+	}
+
+	REBASE(OTG_DIEPTSIZ(ep)) = (pktcnt << OTG_FS_DIEPSIZX_PKTCNT_SHIFT) |
+				   (xfer->len & OTG_FS_DIEPSIZX_XFRSIZ_MASK);
+	REBASE(OTG_DIEPCTL(ep)) |= OTG_FS_DIEPCTL0_EPENA |
+				   OTG_FS_DIEPCTL0_CNAK;
+
+	stm32fx07_ep_transfer_fill(usbd_dev, ep, xfer);
+
+	return 0;
+}
+
 uint16_t stm32fx07_ep_read_packet(usbd_device *usbd_dev, uint8_t addr,
 				  void *buf, uint16_t len)
 {
@@ -225,68 +291,104 @@ uint16_t stm32fx07_ep_read_packet(usbd_device *usbd_dev, uint8_t addr,
 		memcpy(buf32, &extra, i);
 	}
 
-	REBASE(OTG_DOEPTSIZ(addr)) = usbd_dev->doeptsiz[addr];
-	REBASE(OTG_DOEPCTL(addr)) |= OTG_FS_DOEPCTL0_EPENA |
-	    (usbd_dev->force_nak[addr] ?
+	return len;
+}
+
+/*
+ * Re-arm an OUT endpoint once the core reports that the previous transfer or
+ * SETUP stage has completed. Doing this any earlier, e.g. while the packet is
+ * still being popped from the FIFO, corrupts the following DATA OUT stage.
+ */
+static void stm32fx07_ep_out_rearm(usbd_device *usbd_dev, uint8_t ep)
+{
+	REBASE(OTG_DOEPTSIZ(ep)) = usbd_dev->doeptsiz[ep];
+	REBASE(OTG_DOEPCTL(ep)) |= OTG_FS_DOEPCTL0_EPENA |
+	    (usbd_dev->force_nak[ep] ?
 	     OTG_FS_DOEPCTL0_SNAK : OTG_FS_DOEPCTL0_CNAK);
+}
 
-	return len;
+/*
+ * Handle one entry of the receive status queue.
+ *
+ * Data packets (OUT and SETUP) are popped from the FIFO first, the matching
+ * completion entries follow once the core is done with the transaction:
+ *  - SETUP data: the packet is read into control_state.req.
+ *  - SETUP done: the control SETUP callback runs and EP0 OUT is re-armed.
+ *  - OUT data:   the endpoint OUT callback reads the packet.
+ *  - OUT done:   the endpoint is re-armed for the next transfer.
+ */
+static void stm32fx07_rx_status(usbd_device *usbd_dev)
+{
+	uint32_t rxstsp = REBASE(OTG_GRXSTSP);
+	uint32_t pktsts = rxstsp & OTG_FS_GRXSTSP_PKTSTS_MASK;
+	uint8_t ep = rxstsp & OTG_FS_GRXSTSP_EPNUM_MASK;
+	int i;
+
+	/* Save packet size for stm32fx07_ep_read_packet(). */
+	usbd_dev->rxbcnt = (rxstsp & OTG_FS_GRXSTSP_BCNT_MASK) >> 4;
+
+	switch (pktsts) {
+	case OTG_FS_GRXSTSP_PKTSTS_SETUP:
+		usbd_dev->control_state.req_len =
+			stm32fx07_ep_read_packet(usbd_dev, ep,
+						 &usbd_dev->control_state.req, 8);
+		break;
+	case OTG_FS_GRXSTSP_PKTSTS_SETUP_COMP:
+		if (usbd_dev->user_callback_ctr[ep][USB_TRANSACTION_SETUP]) {
+			usbd_dev->user_callback_ctr[ep][USB_TRANSACTION_SETUP]
+				(usbd_dev, ep);
+		}
+		stm32fx07_ep_out_rearm(usbd_dev, ep);
+		break;
+	case OTG_FS_GRXSTSP_PKTSTS_OUT:
+		if (usbd_dev->user_callback_ctr[ep][USB_TRANSACTION_OUT]) {
+			usbd_dev->user_callback_ctr[ep][USB_TRANSACTION_OUT]
+				(usbd_dev, ep);
+		}
+		break;
+	case OTG_FS_GRXSTSP_PKTSTS_OUT_COMP:
+		stm32fx07_ep_out_rearm(usbd_dev, ep);
+		break;
+	default:
+		break;
+	}
+
+	/* Discard unread packet data. */
+	for (i = 0; i < usbd_dev->rxbcnt; i += 4) {
+		(void)*REBASE_FIFO(ep);
+	}
+
+	usbd_dev->rxbcnt = 0;
 }
 
 void stm32fx07_poll(usbd_device *usbd_dev)
 {
 	/* Read interrupt status register. */
 	uint32_t intsts = REBASE(OTG_GINTSTS);
+	uint8_t budget;
 	int i;
 
 	if (intsts & OTG_FS_GINTSTS_ENUMDNE) {
 		/* Handle USB RESET condition. */
 		REBASE(OTG_GINTSTS) = OTG_FS_GINTSTS_ENUMDNE;
 		usbd_dev->fifo_mem_top = usbd_dev->driver->rx_fifo_size;
+		/* IN transfers are dropped, so is their FIFO refilling. */
+		REBASE(OTG_DIEPEMPMSK) = 0;
 		_usbd_reset(usbd_dev);
 		return;
 	}
 
-	/* Note: RX and TX handled differently in this device. */
-	if (intsts & OTG_FS_GINTSTS_RXFLVL) {
+	/*
+	 * Note: RX and TX handled differently in this device.
+	 * Pop receive status entries until the FIFO is empty or the budget
+	 * is spent. Every packet is followed by a completion entry, so one
+	 * packet takes two iterations.
+	 */
+	for (budget = usbd_dev->poll_budget;
+	     budget && (intsts & OTG_FS_GINTSTS_RXFLVL); budget--) {
 		/* Receive FIFO non-empty. */
-		uint32_t rxstsp = REBASE(OTG_GRXSTSP);
-		uint32_t pktsts = rxstsp & OTG_FS_GRXSTSP_PKTSTS_MASK;
-		if ((pktsts != OTG_FS_GRXSTSP_PKTSTS_OUT) &&
-		    (pktsts != OTG_FS_GRXSTSP_PKTSTS_SETUP)) {
-			return;
-		}
-
-		uint8_t ep = rxstsp & OTG_FS_GRXSTSP_EPNUM_MASK;
-		uint8_t type;
-		if (pktsts == OTG_FS_GRXSTSP_PKTSTS_SETUP) {
-			type = USB_TRANSACTION_SETUP;
-		} else {
-			type = USB_TRANSACTION_OUT;
-		}
-
-		/* Save packet size for stm32f107_ep_read_packet(). */
-		usbd_dev->rxbcnt = (rxstsp & OTG_FS_GRXSTSP_BCNT_MASK) >> 4;
-
-		/*
-		 * FIXME: Why is a delay needed here?
-		 * This appears to fix a problem where the first 4 bytes
-		 * of the DATA OUT stage of a control transaction are lost.
-		 */
-		for (i = 0; i < 1000; i++) {
-			__asm__("nop");
-		}
-
-		if (usbd_dev->user_callback_ctr[ep][type]) {
-			usbd_dev->user_callback_ctr[ep][type] (usbd_dev, ep);
-		}
-
-		/* Discard unread packet data. */
-		for (i = 0; i < usbd_dev->rxbcnt; i += 4) {
-			(void)*REBASE_FIFO(ep);
-		}
-
-		usbd_dev->rxbcnt = 0;
+		stm32fx07_rx_status(usbd_dev);
+		intsts = REBASE(OTG_GINTSTS);
 	}
 
 	/*
@@ -294,6 +396,19 @@ void stm32fx07_poll(usbd_device *usbd_dev)
 	 * The XFRC bit must be checked in each OTG_FS_DIEPINT(x).
 	 */
 	for (i = 0; i < 4; i++) { /* Iterate over endpoints. */
+		if ((REBASE(OTG_DIEPEMPMSK) & (1 << i)) &&
+		    (REBASE(OTG_DIEPINT(i)) & OTG_FS_DIEPINTX_TXFE)) {
+			if (usbd_dev->transfer[i][USB_TRANSACTION_IN]) {
+				/* Room in the TX FIFO for more of a transfer. */
+				stm32fx07_ep_transfer_fill(usbd_dev, i,
+					usbd_dev->transfer[i]
+							  [USB_TRANSACTION_IN]);
+			} else {
+				/* Nothing left to send, stop refilling. */
+				REBASE(OTG_DIEPEMPMSK) &= ~(1 << i);
+			}
+		}
+
 		if (REBASE(OTG_DIEPINT(i)) & OTG_FS_DIEPINTX_XFRC) {
 			/* Transfer complete. */
 			if (usbd_dev->user_callback_ctr[i]
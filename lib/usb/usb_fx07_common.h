@@ -32,6 +32,8 @@ uint16_t stm32fx07_ep_write_packet(usbd_device *usbd_dev, uint8_t addr,
 				   const void *buf, uint16_t len);
 uint16_t stm32fx07_ep_read_packet(usbd_device *usbd_dev, uint8_t addr,
 				  void *buf, uint16_t len);
+int stm32fx07_ep_transfer_in(usbd_device *usbd_dev, uint8_t ep,
+			     struct usbd_transfer *xfer);
 void stm32fx07_poll(usbd_device *usbd_dev);
 void stm32fx07_disconnect(usbd_device *usbd_dev, bool disconnected);
 
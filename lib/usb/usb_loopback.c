@@ -0,0 +1,485 @@
+/** @defgroup usb_loopback_file USB Loopback Driver
+
+@ingroup USB
+
+@brief <b>Memory-backed USB driver and host model</b>
+
+The loopback driver implements the usbd_driver interface on plain memory. Each
+endpoint has one packet buffer per direction, which behaves like the buffer of
+a USB peripheral: the host side fills or drains it with tokens, and the device
+side sees the matching transaction callbacks from usbd_poll().
+
+LGPL License Terms @ref lgpl_license
+*/
+
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**@{*/
+
+#include <string.h>
+#include <libopencm3/usb/usbd.h>
+#include <libopencm3/usb/loopback.h>
+#include "usb_private.h"
+
+/* Tokens the host model retries on NAK before giving up */
+#define LOOPBACK_RETRIES	64
+
+static usbd_device *loopback_usbd_init(void);
+static void loopback_set_address(usbd_device *usbd_dev, uint8_t addr);
+static void loopback_ep_setup(usbd_device *usbd_dev, uint8_t addr,
+			      uint8_t type, uint16_t max_size,
+			      void (*callback) (usbd_device *usbd_dev,
+						uint8_t ep));
+static void loopback_endpoints_reset(usbd_device *usbd_dev);
+static void loopback_ep_stall_set(usbd_device *usbd_dev, uint8_t addr,
+				  uint8_t stall);
+static uint8_t loopback_ep_stall_get(usbd_device *usbd_dev, uint8_t addr);
+static void loopback_ep_nak_set(usbd_device *usbd_dev, uint8_t addr,
+				uint8_t nak);
+static uint16_t loopback_ep_write_packet(usbd_device *usbd_dev, uint8_t addr,
+					 const void *buf, uint16_t len);
+static uint16_t loopback_ep_read_packet(usbd_device *usbd_dev, uint8_t addr,
+					void *buf, uint16_t len);
+static void loopback_poll(usbd_device *usbd_dev);
+
+struct loopback_ep {
+	uint8_t buf[USB_LOOPBACK_PACKET_SIZE];
+	uint16_t len;
+	uint16_t max_size;
+	bool full;
+	bool stall;
+	bool nak;
+};
+
+/* Endpoint buffers, indexed by endpoint number and enum _usbd_transaction */
+static struct loopback_ep endpoints[8][2];
+/* Transactions waiting for usbd_poll(), one bit per enum _usbd_transaction */
+static uint8_t pending[8];
+static bool reset_pending;
+static bool sof_pending;
+static uint8_t address;
+static struct usb_loopback_stats stats;
+static struct _usbd_device usbd_dev;
+
+const struct _usbd_driver loopback_usb_driver = {
+	.init = loopback_usbd_init,
+	.set_address = loopback_set_address,
+	.ep_setup = loopback_ep_setup,
+	.ep_reset = loopback_endpoints_reset,
+	.ep_stall_set = loopback_ep_stall_set,
+	.ep_stall_get = loopback_ep_stall_get,
+	.ep_nak_set = loopback_ep_nak_set,
+	.ep_write_packet = loopback_ep_write_packet,
+	.ep_read_packet = loopback_ep_read_packet,
+	.poll = loopback_poll,
+};
+
+static usbd_device *loopback_usbd_init(void)
+{
+	memset(endpoints, 0, sizeof(endpoints));
+	memset(pending, 0, sizeof(pending));
+	memset(&stats, 0, sizeof(stats));
+	address = 0;
+	sof_pending = false;
+
+	/* The bus starts out in reset, like a freshly attached device. */
+	reset_pending = true;
+	return &usbd_dev;
+}
+
+static void loopback_set_address(usbd_device *dev, uint8_t addr)
+{
+	(void)dev;
+	address = addr;
+}
+
+static void loopback_ep_setup(usbd_device *dev, uint8_t addr, uint8_t type,
+			      uint16_t max_size,
+			      void (*callback) (usbd_device *usbd_dev,
+						uint8_t ep))
+{
+	uint8_t dir = addr & 0x80;
+	struct loopback_ep *lep;
+
+	(void)type;
+	addr &= 0x7f;
+
+	if (dir || (addr == 0)) {
+		lep = &endpoints[addr][USB_TRANSACTION_IN];
+		memset(lep, 0, sizeof(*lep));
+		lep->max_size = MIN(max_size, USB_LOOPBACK_PACKET_SIZE);
+		if (callback) {
+			dev->user_callback_ctr[addr][USB_TRANSACTION_IN] =
+			    callback;
+		}
+	}
+
+	if (!dir) {
+		lep = &endpoints[addr][USB_TRANSACTION_OUT];
+		memset(lep, 0, sizeof(*lep));
+		lep->max_size = MIN(max_size, USB_LOOPBACK_PACKET_SIZE);
+		if (callback) {
+			dev->user_callback_ctr[addr][USB_TRANSACTION_OUT] =
+			    callback;
+		}
+	}
+}
+
+static void loopback_endpoints_reset(usbd_device *dev)
+{
+	int i;
+
+	(void)dev;
+
+	/* Reset all endpoints. */
+	for (i = 1; i < 8; i++) {
+		memset(endpoints[i], 0, sizeof(endpoints[i]));
+		pending[i] = 0;
+	}
+}
+
+static void loopback_ep_stall_set(usbd_device *dev, uint8_t addr,
+				  uint8_t stall)
+{
+	(void)dev;
+
+	if (addr == 0) {
+		endpoints[0][USB_TRANSACTION_IN].stall = stall;
+	}
+
+	if (addr & 0x80) {
+		endpoints[addr & 0x7f][USB_TRANSACTION_IN].stall = stall;
+	} else {
+		endpoints[addr][USB_TRANSACTION_OUT].stall = stall;
+	}
+}
+
+static uint8_t loopback_ep_stall_get(usbd_device *dev, uint8_t addr)
+{
+	(void)dev;
+
+	if (addr & 0x80) {
+		return endpoints[addr & 0x7f][USB_TRANSACTION_IN].stall;
+	}
+	return endpoints[addr][USB_TRANSACTION_OUT].stall;
+}
+
+static void loopback_ep_nak_set(usbd_device *dev, uint8_t addr, uint8_t nak)
+{
+	(void)dev;
+	/* It does not make sense to force NAK on IN endpoints. */
+	if (addr & 0x80) {
+		return;
+	}
+
+	endpoints[addr][USB_TRANSACTION_OUT].nak = nak;
+}
+
+static uint16_t loopback_ep_write_packet(usbd_device *dev, uint8_t addr,
+					 const void *buf, uint16_t len)
+{
+	struct loopback_ep *lep = &endpoints[addr & 0x7f][USB_TRANSACTION_IN];
+
+	(void)dev;
+
+	if (lep->full) {
+		return 0;
+	}
+
+	len = MIN(len, lep->max_size);
+	if (len) {
+		memcpy(lep->buf, buf, len);
+	}
+	lep->len = len;
+	lep->full = true;
+
+	return len;
+}
+
+static uint16_t loopback_ep_read_packet(usbd_device *dev, uint8_t addr,
+					void *buf, uint16_t len)
+{
+	struct loopback_ep *lep = &endpoints[addr][USB_TRANSACTION_OUT];
+
+	(void)dev;
+
+	if (!lep->full) {
+		return 0;
+	}
+
+	len = MIN(len, lep->len);
+	if (len) {
+		memcpy(buf, lep->buf, len);
+	}
+	lep->full = false;
+
+	return len;
+}
+
+static void loopback_dispatch(usbd_device *dev, uint8_t ep,
+			      enum _usbd_transaction type)
+{
+	pending[ep] &= ~(1 << type);
+
+	if (type == USB_TRANSACTION_SETUP) {
+		dev->control_state.req_len = loopback_ep_read_packet(dev, ep,
+					&dev->control_state.req, 8);
+	}
+
+	if (dev->user_callback_ctr[ep][type]) {
+		stats.callbacks++;
+		dev->user_callback_ctr[ep][type] (dev, ep);
+	} else if (type != USB_TRANSACTION_IN) {
+		/* Nobody listens, drop the packet. */
+		endpoints[ep][USB_TRANSACTION_OUT].full = false;
+	}
+}
+
+static void loopback_poll(usbd_device *dev)
+{
+	uint8_t budget = dev->poll_budget;
+	int ep, type;
+
+	if (reset_pending) {
+		reset_pending = false;
+		_usbd_reset(dev);
+		return;
+	}
+
+	if (sof_pending) {
+		sof_pending = false;
+		if (dev->user_callback_sof) {
+			dev->user_callback_sof();
+		}
+	}
+
+	/*
+	 * Handle SETUP before OUT before IN on each endpoint, like the
+	 * status register of a peripheral would report them.
+	 */
+	for (ep = 0; ep < 8; ep++) {
+		for (type = USB_TRANSACTION_SETUP;
+		     type >= USB_TRANSACTION_IN; type--) {
+			if (!budget) {
+				return;
+			}
+			if (pending[ep] & (1 << type)) {
+				loopback_dispatch(dev, ep, type);
+				budget--;
+			}
+		}
+	}
+}
+
+/** @brief Signal a bus reset, handled by the next usbd_poll(). */
+void usb_loopback_bus_reset(usbd_device *dev)
+{
+	(void)dev;
+
+	memset(endpoints, 0, sizeof(endpoints));
+	memset(pending, 0, sizeof(pending));
+	reset_pending = true;
+}
+
+/** @brief Send a start of frame, handled by the next usbd_poll(). */
+void usb_loopback_sof(usbd_device *dev)
+{
+	(void)dev;
+
+	sof_pending = true;
+	stats.sof++;
+}
+
+/** @brief Send a SETUP token with its 8 byte data packet to endpoint 0.
+
+A SETUP packet is always accepted. It clears a stall of endpoint 0 and
+discards data still waiting in the endpoint 0 buffers.
+
+@returns 8, the number of bytes sent.
+*/
+int usb_loopback_setup(usbd_device *dev,
+		       const struct usb_setup_data *req)
+{
+	struct loopback_ep *out = &endpoints[0][USB_TRANSACTION_OUT];
+	struct loopback_ep *in = &endpoints[0][USB_TRANSACTION_IN];
+
+	(void)dev;
+
+	memcpy(out->buf, req, 8);
+	out->len = 8;
+	out->full = true;
+	out->stall = false;
+	in->full = false;
+	in->stall = false;
+
+	pending[0] = 1 << USB_TRANSACTION_SETUP;
+	stats.setup++;
+
+	return 8;
+}
+
+/** @brief Send an IN token and receive the packet the device has queued.
+
+@param[in] ep Endpoint number, without the direction bit.
+@param[out] buf Receives up to len bytes of the packet.
+@returns Bytes received, @ref USB_LOOPBACK_NAK if no packet is queued or
+	@ref USB_LOOPBACK_STALL.
+*/
+int usb_loopback_in(usbd_device *dev, uint8_t ep, void *buf,
+		    uint16_t len)
+{
+	struct loopback_ep *lep = &endpoints[ep & 0x7f][USB_TRANSACTION_IN];
+
+	(void)dev;
+	ep &= 0x7f;
+
+	if (lep->stall) {
+		stats.stall++;
+		return USB_LOOPBACK_STALL;
+	}
+	if (!lep->full) {
+		stats.nak++;
+		return USB_LOOPBACK_NAK;
+	}
+
+	len = MIN(len, lep->len);
+	if (len) {
+		memcpy(buf, lep->buf, len);
+	}
+	lep->full = false;
+
+	pending[ep] |= 1 << USB_TRANSACTION_IN;
+	stats.in++;
+
+	return len;
+}
+
+/** @brief Send an OUT token followed by a data packet.
+
+@param[in] ep Endpoint number, without the direction bit.
+@param[in] buf Packet data, at most the endpoint's packet size is sent.
+@returns Bytes sent, @ref USB_LOOPBACK_NAK if the endpoint buffer is still
+	full or NAK is forced, or @ref USB_LOOPBACK_STALL.
+*/
+int usb_loopback_out(usbd_device *dev, uint8_t ep, const void *buf,
+		     uint16_t len)
+{
+	struct loopback_ep *lep = &endpoints[ep & 0x7f][USB_TRANSACTION_OUT];
+
+	(void)dev;
+	ep &= 0x7f;
+
+	if (lep->stall) {
+		stats.stall++;
+		return USB_LOOPBACK_STALL;
+	}
+	if (lep->full || lep->nak) {
+		stats.nak++;
+		return USB_LOOPBACK_NAK;
+	}
+
+	len = MIN(len, lep->max_size);
+	if (len) {
+		memcpy(lep->buf, buf, len);
+	}
+	lep->len = len;
+	lep->full = true;
+
+	pending[ep] |= 1 << USB_TRANSACTION_OUT;
+	stats.out++;
+
+	return len;
+}
+
+/* Issue a token, letting the device run between NAKed attempts. */
+static int loopback_token(usbd_device *dev, bool in, void *buf,
+			  uint16_t len)
+{
+	int i, ret = USB_LOOPBACK_NAK;
+
+	for (i = 0; (i < LOOPBACK_RETRIES) && (ret == USB_LOOPBACK_NAK); i++) {
+		if (in) {
+			ret = usb_loopback_in(dev, 0, buf, len);
+		} else {
+			ret = usb_loopback_out(dev, 0, buf, len);
+		}
+		usbd_poll(dev);
+	}
+
+	return ret;
+}
+
+/** @brief Run a complete control transfer on endpoint 0.
+
+Sends the SETUP stage, moves req->wLength bytes in the direction given by
+req->bmRequestType and finishes with the status stage, calling usbd_poll()
+as needed.
+
+@param[in] req Setup packet.
+@param[in,out] buf Data stage buffer of req->wLength bytes.
+@returns Bytes moved in the data stage, or @ref USB_LOOPBACK_NAK or
+	@ref USB_LOOPBACK_STALL if a stage failed.
+*/
+int usb_loopback_control(usbd_device *dev,
+			 const struct usb_setup_data *req, void *buf)
+{
+	uint8_t ep0_size = dev->desc->bMaxPacketSize0;
+	uint8_t *data = buf;
+	bool in = req->bmRequestType & USB_REQ_TYPE_IN;
+	int done = 0, ret;
+
+	usb_loopback_setup(dev, req);
+	usbd_poll(dev);
+
+	while (done < req->wLength) {
+		ret = loopback_token(dev, in, data + done,
+				     MIN(ep0_size, req->wLength - done));
+		if (ret < 0) {
+			return ret;
+		}
+		done += ret;
+		if (ret < ep0_size) {
+			break;
+		}
+	}
+
+	/* Status stage, a zero-length packet in the other direction */
+	ret = loopback_token(dev, !in, NULL, 0);
+	if (ret < 0) {
+		return ret;
+	}
+
+	return done;
+}
+
+/** @brief Address assigned to the device by SET_ADDRESS. */
+uint8_t usb_loopback_get_address(usbd_device *dev)
+{
+	(void)dev;
+	return address;
+}
+
+/** @brief Token and callback counters since usbd_init(). */
+struct usb_loopback_stats *usb_loopback_get_stats(usbd_device *dev)
+{
+	(void)dev;
+	return &stats;
+}
+
+/**@}*/
+
@@ -167,6 +167,21 @@ struct usb_msc_trans {
 		struct usb_msc_csw csw;
 		uint8_t buf[1];
 	} csw;
+
+	/* Pipelined data stage, see usb_msc_set_async_storage(). */
+	bool async;			/* Data stage runs through the pipeline */
+	bool async_failed;
+	bool usb_busy;
+	bool storage_busy;
+	uint32_t usb_issued;		/* Blocks handed to the USB endpoint */
+	uint32_t usb_done;
+	uint32_t storage_issued;	/* Blocks handed to the storage backend */
+	uint32_t storage_done;
+	uint32_t usb_count;		/* Blocks in the current USB transfer */
+	uint32_t storage_count;		/* Blocks in the current storage request */
+	struct usbd_transfer xfer;
+	uint8_t stash_len;		/* OUT packet received between transfers */
+	uint8_t stash[64];
 };
 
 struct _usbd_mass_storage {
@@ -187,6 +202,12 @@ struct _usbd_mass_storage {
 	void (*lock)(void);
 	void (*unlock)(void);
 
+	uint8_t *block_buf;		/* Pipeline buffers, num_block_buf blocks */
+	uint8_t num_block_buf;
+	int (*read_blocks)(uint32_t lba, uint8_t *copy_to, uint32_t count);
+	int (*write_blocks)(uint32_t lba, const uint8_t *copy_from,
+			    uint32_t count);
+
 	struct usb_msc_trans trans;
 	struct sbc_sense_info sense;
 };
@@ -531,6 +552,229 @@ static void scsi_command(usbd_mass_storage *ms,
 	}
 }
 
+/*-- Pipelined Data Stage ----------------------------------------------------*/
+
+/*
+ * READ and WRITE commands on a device with asynchronous storage move their
+ * data through a ring of num_block_buf block buffers. For READ, the storage
+ * backend fills buffers ahead of the IN endpoint; for WRITE, the OUT
+ * endpoint fills buffers ahead of the storage backend. Both sides work on
+ * runs of contiguous buffers, so the USB side needs one transfer and the
+ * storage side one request per run instead of one per block or packet.
+ */
+
+static void msc_data_tx_cb(usbd_device *usbd_dev, uint8_t ep);
+static void msc_async_usb_kick(usbd_mass_storage *ms);
+static void msc_async_storage_kick(usbd_mass_storage *ms);
+
+static uint8_t *msc_async_buf(usbd_mass_storage *ms, uint32_t block)
+{
+	return &ms->block_buf[(block % ms->num_block_buf) << 9];
+}
+
+/*
+ * Number of blocks, starting at block, that may be handed to one side:
+ * limited by the work left, the buffers not held by the other side, the wrap
+ * around of the ring and the 16 bit length of a USB transfer.
+ */
+static uint32_t msc_async_run(usbd_mass_storage *ms, uint32_t block,
+			      uint32_t limit, uint32_t held)
+{
+	uint32_t count = MIN(limit - block,
+			     (uint32_t)ms->num_block_buf - held);
+
+	count = MIN(count, ms->num_block_buf - (block % ms->num_block_buf));
+	return MIN(count, 127);
+}
+
+static void msc_async_finish(usbd_mass_storage *ms)
+{
+	struct usb_msc_trans *trans = &ms->trans;
+
+	trans->async = false;
+	trans->current_block = trans->block_count;
+	trans->byte_count = trans->bytes_to_read + trans->bytes_to_write;
+
+	if (trans->async_failed) {
+		trans->csw.csw.bCSWStatus = CSW_STATUS_FAILED;
+	}
+
+	/* Send the CSW from the regular IN handler. */
+	msc_data_tx_cb(ms->usbd_dev, ms->ep_in);
+}
+
+static void msc_async_fail(usbd_mass_storage *ms, bool read)
+{
+	ms->trans.async_failed = true;
+	if (read) {
+		set_sbc_status(ms, SBC_SENSE_KEY_MEDIUM_ERROR,
+			       SBC_ASC_UNRECOVERED_READ_ERROR, SBC_ASCQ_NA);
+	} else {
+		set_sbc_status(ms, SBC_SENSE_KEY_MEDIUM_ERROR,
+			       SBC_ASC_PERIPHERAL_DEVICE_WRITE_FAULT,
+			       SBC_ASCQ_NA);
+	}
+}
+
+static void msc_async_usb_complete(usbd_device *usbd_dev,
+				   struct usbd_transfer *xfer)
+{
+	usbd_mass_storage *ms = &_mass_storage;
+	struct usb_msc_trans *trans = &ms->trans;
+
+	(void)usbd_dev;
+
+	if (xfer->actual != xfer->len) {
+		/* Short OUT transfer, the host gave up on the data stage. */
+		msc_async_fail(ms, false);
+		trans->usb_done = trans->block_count;
+		trans->storage_done = trans->block_count;
+		trans->usb_busy = false;
+		msc_async_finish(ms);
+		return;
+	}
+
+	trans->usb_done += trans->usb_count;
+	trans->usb_busy = false;
+
+	if (trans->bytes_to_write && (trans->usb_done == trans->block_count)) {
+		msc_async_finish(ms);
+		return;
+	}
+
+	msc_async_storage_kick(ms);
+	msc_async_usb_kick(ms);
+}
+
+static void msc_async_usb_kick(usbd_mass_storage *ms)
+{
+	struct usb_msc_trans *trans = &ms->trans;
+	uint8_t *buf;
+	uint32_t count;
+
+	if (trans->usb_busy || !trans->async) {
+		return;
+	}
+
+	if (trans->bytes_to_write) {
+		/* READ: send what the storage has filled. */
+		if (trans->usb_issued == trans->storage_done) {
+			return;
+		}
+		count = msc_async_run(ms, trans->usb_issued,
+				      trans->storage_done, 0);
+		buf = msc_async_buf(ms, trans->usb_issued);
+
+		trans->xfer.buf = buf;
+		trans->xfer.len = count << 9;
+		trans->xfer.flags = 0;
+		trans->xfer.complete = msc_async_usb_complete;
+		trans->usb_count = count;
+		trans->usb_issued += count;
+		trans->usb_busy = true;
+		usbd_ep_transfer(ms->usbd_dev, ms->ep_in, &trans->xfer);
+		return;
+	}
+
+	/* WRITE: receive into buffers the storage is not holding. */
+	if (trans->usb_issued == trans->block_count) {
+		return;
+	}
+	count = msc_async_run(ms, trans->usb_issued, trans->block_count,
+			      trans->usb_issued - trans->storage_done);
+	if (count == 0) {
+		usbd_ep_nak_set(ms->usbd_dev, ms->ep_out, 1);
+		return;
+	}
+	buf = msc_async_buf(ms, trans->usb_issued);
+
+	/* Put a packet that arrived between transfers first. */
+	memcpy(buf, trans->stash, trans->stash_len);
+
+	trans->xfer.buf = buf + trans->stash_len;
+	trans->xfer.len = (count << 9) - trans->stash_len;
+	trans->xfer.flags = 0;
+	trans->xfer.complete = msc_async_usb_complete;
+	trans->stash_len = 0;
+	trans->usb_count = count;
+	trans->usb_issued += count;
+	trans->usb_busy = true;
+	usbd_ep_transfer(ms->usbd_dev, ms->ep_out, &trans->xfer);
+	usbd_ep_nak_set(ms->usbd_dev, ms->ep_out, 0);
+}
+
+static void msc_async_storage_kick(usbd_mass_storage *ms)
+{
+	struct usb_msc_trans *trans = &ms->trans;
+	uint32_t lba, count;
+	uint8_t *buf;
+	int ret;
+
+	if (trans->storage_busy || !trans->async) {
+		return;
+	}
+
+	lba = trans->lba_start + trans->storage_issued;
+	buf = msc_async_buf(ms, trans->storage_issued);
+
+	if (trans->bytes_to_write) {
+		/* READ: fill buffers the USB side has sent. */
+		if (trans->storage_issued == trans->block_count) {
+			return;
+		}
+		count = msc_async_run(ms, trans->storage_issued,
+				      trans->block_count,
+				      trans->storage_issued - trans->usb_done);
+		if (count == 0) {
+			return;
+		}
+		trans->storage_count = count;
+		trans->storage_issued += count;
+		trans->storage_busy = true;
+		ret = (*ms->read_blocks)(lba, buf, count);
+	} else {
+		/* WRITE: store what the USB side has received. */
+		if (trans->storage_issued == trans->usb_done) {
+			return;
+		}
+		count = msc_async_run(ms, trans->storage_issued,
+				      trans->usb_done, 0);
+		trans->storage_count = count;
+		trans->storage_issued += count;
+		trans->storage_busy = true;
+		ret = (*ms->write_blocks)(lba, buf, count);
+	}
+
+	if (ret != 0) {
+		usb_msc_storage_complete(ms, ret);
+	}
+}
+
+static void msc_async_start(usbd_mass_storage *ms)
+{
+	struct usb_msc_trans *trans = &ms->trans;
+
+	if (NULL != ms->lock) {
+		(*ms->lock)();
+	}
+
+	trans->async = true;
+	trans->async_failed = false;
+	trans->usb_busy = false;
+	trans->storage_busy = false;
+	trans->usb_issued = 0;
+	trans->usb_done = 0;
+	trans->storage_issued = 0;
+	trans->storage_done = 0;
+	trans->stash_len = 0;
+
+	if (trans->bytes_to_write) {
+		msc_async_storage_kick(ms);
+	} else {
+		msc_async_usb_kick(ms);
+	}
+}
+
 /*-- USB Mass Storage Layer --------------------------------------------------*/
 
 /** @brief Handle the USB 'OUT' requests. */
@@ -544,6 +788,19 @@ static void msc_data_rx_cb(usbd_device *usbd_dev, uint8_t ep)
 	ms = &_mass_storage;
 	trans = &ms->trans;
 
+	if (trans->async) {
+		/*
+		 * Data stage packet that arrived before the next buffer was
+		 * ready. Keep it for msc_async_usb_kick() and hold off the
+		 * host until then.
+		 */
+		usbd_ep_nak_set(usbd_dev, ep, 1);
+		trans->stash_len = usbd_ep_read_packet(usbd_dev, ep,
+						       trans->stash,
+						       sizeof(trans->stash));
+		return;
+	}
+
 	/* RX only */
 	left = sizeof(struct usb_msc_cbw) - trans->cbw_cnt;
 	if (0 < left) {
@@ -554,6 +811,12 @@ static void msc_data_rx_cb(usbd_device *usbd_dev, uint8_t ep)
 
 		if (sizeof(struct usb_msc_cbw) == trans->cbw_cnt) {
 			scsi_command(ms, trans, EVENT_CBW_VALID);
+			if ((0 < trans->block_count) &&
+			    (NULL != ms->block_buf) &&
+			    (trans->bytes_to_read || trans->bytes_to_write)) {
+				msc_async_start(ms);
+				return;
+			}
 			if (trans->byte_count < trans->bytes_to_read) {
 				/* We must wait until there is something to
 				 * read again. */
@@ -793,6 +1056,8 @@ usbd_mass_storage *usb_msc_init(usbd_device *usbd_dev,
 	_mass_storage.write_block = write_block;
 	_mass_storage.lock = NULL;
 	_mass_storage.unlock = NULL;
+	_mass_storage.block_buf = NULL;
+	_mass_storage.num_block_buf = 0;
 
 	_mass_storage.trans.lba_start = 0xffffffff;
 	_mass_storage.trans.block_count = 0;
@@ -811,4 +1076,70 @@ usbd_mass_storage *usb_msc_init(usbd_device *usbd_dev,
 	return &_mass_storage;
 }
 
+/** @brief Use pipelined, asynchronous block storage for READ and WRITE.
+
+The data stage of READ and WRITE commands then moves through a ring of block
+buffers: the storage backend is asked for runs of consecutive blocks while
+earlier blocks are still being transferred over USB, and vice versa. The
+synchronous read_block and write_block callbacks passed to usb_msc_init() are
+still used by the other commands.
+
+The backend starts a request from read_blocks or write_blocks and reports its
+end by calling usb_msc_storage_complete(), either before returning or later,
+e.g. from a DMA interrupt. Only one request is outstanding at a time.
+usb_msc_storage_complete() must not run concurrently with usbd_poll(): call
+it from the same interrupt priority, or with the USB interrupt masked.
+
+@param[in] ms The mass storage instance returned by usb_msc_init().
+@param[in] buf Block buffers, num_blocks * 512 bytes.
+@param[in] num_blocks Number of block buffers, at least 2 for any overlap.
+@param[in] read_blocks Start reading count blocks from lba into copy_to.
+		Return 0 if started, non-zero on immediate failure.
+@param[in] write_blocks Start writing count blocks from copy_from to lba.
+		Return 0 if started, non-zero on immediate failure.
+*/
+void usb_msc_set_async_storage(usbd_mass_storage *ms,
+			       uint8_t *buf, uint8_t num_blocks,
+			       int (*read_blocks)(uint32_t lba, uint8_t *copy_to,
+						  uint32_t count),
+			       int (*write_blocks)(uint32_t lba,
+						   const uint8_t *copy_from,
+						   uint32_t count))
+{
+	ms->block_buf = buf;
+	ms->num_block_buf = num_blocks;
+	ms->read_blocks = read_blocks;
+	ms->write_blocks = write_blocks;
+}
+
+/** @brief Report the end of a read_blocks or write_blocks request.
+
+@param[in] ms The mass storage instance.
+@param[in] status 0 on success, non-zero if the request failed. A failed
+		request completes the command with a medium error.
+*/
+void usb_msc_storage_complete(usbd_mass_storage *ms, int status)
+{
+	struct usb_msc_trans *trans = &ms->trans;
+
+	if (!trans->async || !trans->storage_busy) {
+		return;
+	}
+
+	if (status != 0) {
+		msc_async_fail(ms, trans->bytes_to_write != 0);
+	}
+
+	trans->storage_done += trans->storage_count;
+	trans->storage_busy = false;
+
+	if (trans->bytes_to_read && (trans->storage_done == trans->block_count)) {
+		msc_async_finish(ms);
+		return;
+	}
+
+	msc_async_usb_kick(ms);
+	msc_async_storage_kick(ms);
+}
+
 /** @} */
@@ -43,10 +43,14 @@ LGPL License Terms @ref lgpl_license
 
 #define MIN(a, b) ((a) < (b) ? (a) : (b))
 
+/* Strips flags such as USBD_EP_DOUBLEBUF from an endpoint type. */
+#define USBD_EP_TYPE_MASK	0x03
+
 /** Internal collection of device information. */
 struct _usbd_device {
 	const struct usb_device_descriptor *desc;
 	const struct usb_config_descriptor *config;
+	const uint8_t * const *config_descs; /**< Serialized configurations */
 	const char **strings;
 	int num_strings;
 
@@ -58,12 +62,18 @@ struct _usbd_device {
 
 	uint16_t pm_top;    /**< Top of allocated endpoint buffer memory */
 
+	uint8_t poll_budget; /**< Endpoint events handled per usbd_poll() */
+
 	/* User callback functions for various USB events */
 	void (*user_callback_reset)(void);
 	void (*user_callback_suspend)(void);
 	void (*user_callback_resume)(void);
 	void (*user_callback_sof)(void);
 
+	/*
+	 * Drivers must read the SETUP packet into control_state.req before
+	 * invoking the USB_TRANSACTION_SETUP callback of endpoint 0.
+	 */
 	struct usb_control_state {
 		enum {
 			IDLE, STALLED,
@@ -71,7 +81,11 @@ struct _usbd_device {
 			DATA_OUT, LAST_DATA_OUT, STATUS_OUT,
 		} state;
 		struct usb_setup_data req __attribute__((aligned(4)));
+		/* Bytes the driver read into req, 8 for a valid SETUP */
+		uint16_t req_len;
 		uint8_t *ctrl_buf;
+		/* Read-only data sent instead of ctrl_buf, if set */
+		const uint8_t *ctrl_const_buf;
 		uint16_t ctrl_len;
 		void (*complete)(usbd_device *usbd_dev,
 				 struct usb_setup_data *req);
@@ -85,6 +99,10 @@ struct _usbd_device {
 
 	void (*user_callback_ctr[8][3])(usbd_device *usbd_dev, uint8_t ea);
 
+	/* Endpoint transfers in progress and packet sizes, by direction */
+	struct usbd_transfer *transfer[8][2];
+	uint16_t ep_size[8][2];
+
 	/* User callback function for some standard USB function hooks */
 	void (*user_callback_set_config[MAX_USER_SET_CONFIG_CALLBACK])
 				(usbd_device *usbd_dev, uint16_t wValue);
@@ -136,6 +154,8 @@ int _usbd_standard_request(usbd_device *usbd_dev, struct usb_setup_data *req,
 
 void _usbd_reset(usbd_device *usbd_dev);
 
+void _usbd_transfer_reset(usbd_device *usbd_dev);
+
 /* Functions provided by the hardware abstraction. */
 struct _usbd_driver {
 	usbd_device *(*init)(void);
@@ -154,6 +174,14 @@ struct _usbd_driver {
 				   void *buf, uint16_t len);
 	void (*poll)(usbd_device *usbd_dev);
 	void (*disconnect)(usbd_device *usbd_dev, bool disconnected);
+	/*
+	 * Optional: program a multi-packet IN transfer into the hardware.
+	 * Returns -1 if the endpoint is busy, 1 to leave the transfer to the
+	 * generic packet-by-packet code and 0 on success, in which case the
+	 * IN callback must be called once, after the whole transfer was sent.
+	 */
+	int (*ep_transfer_in)(usbd_device *usbd_dev, uint8_t ep,
+			      struct usbd_transfer *xfer);
 	uint32_t base_address;
 	bool set_address_before_status;
 	uint16_t rx_fifo_size;
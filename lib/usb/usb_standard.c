@@ -56,11 +56,28 @@ int usbd_register_set_config_callback(usbd_device *usbd_dev,
 	return -1;
 }
 
-static uint16_t build_config_descriptor(usbd_device *usbd_dev,
-				   uint8_t index, uint8_t *buf, uint16_t len)
+/**
+ * Serialize a configuration descriptor tree.
+ *
+ * Writes the configuration descriptor followed by all interface association,
+ * interface, endpoint and extra descriptors in the order the host expects
+ * them, and fills in wTotalLength.
+ *
+ * The USB stack does this for every GET_DESCRIPTOR(CONFIGURATION) request,
+ * unless serialized descriptors were registered with
+ * usbd_register_config_descriptors(). This function can be used to produce
+ * those once, for example at startup.
+ *
+ * @param cfg Configuration descriptor tree
+ * @param buf Buffer to write to
+ * @param len Size of buf, the output is truncated to this length
+ * @return Number of bytes written
+ */
+uint16_t usbd_serialize_config_descriptor(
+		const struct usb_config_descriptor *cfg,
+		uint8_t *buf, uint16_t len)
 {
 	uint8_t *tmpbuf = buf;
-	const struct usb_config_descriptor *cfg = &usbd_dev->config[index];
 	uint16_t count, total = 0, totallen = 0;
 	uint16_t i, j, k;
 
@@ -129,6 +146,36 @@ static uint16_t build_config_descriptor(usbd_device *usbd_dev,
 	return total;
 }
 
+static uint16_t build_config_descriptor(usbd_device *usbd_dev,
+				   uint8_t index, uint8_t *buf, uint16_t len)
+{
+	return usbd_serialize_config_descriptor(&usbd_dev->config[index],
+						buf, len);
+}
+
+/**
+ * Register serialized configuration descriptors.
+ *
+ * GET_DESCRIPTOR(CONFIGURATION) requests are then answered straight from
+ * these buffers instead of assembling the descriptor tree in the control
+ * buffer each time, so the control buffer only needs to be large enough for
+ * the other requests of the device. The buffers can be const data in flash,
+ * written by hand or produced by usbd_serialize_config_descriptor().
+ *
+ * The configuration descriptor tree passed to usbd_init() is still used for
+ * all other standard requests and must describe the same configurations.
+ *
+ * @param usbd_dev USB device handle
+ * @param descs Array of bNumConfigurations serialized descriptors, in the
+ *              order of the configuration descriptor array, or NULL to go
+ *              back to building them on request.
+ */
+void usbd_register_config_descriptors(usbd_device *usbd_dev,
+				      const uint8_t * const *descs)
+{
+	usbd_dev->config_descs = descs;
+}
+
 static int usb_descriptor_type(uint16_t wValue)
 {
 	return wValue >> 8;
@@ -154,6 +201,17 @@ static int usb_standard_get_descriptor(usbd_device *usbd_dev,
 		*len = MIN(*len, usbd_dev->desc->bLength);
 		return USBD_REQ_HANDLED;
 	case USB_DT_CONFIGURATION:
+		if (descr_idx >= usbd_dev->desc->bNumConfigurations) {
+			return USBD_REQ_NOTSUPP;
+		}
+		if (usbd_dev->config_descs) {
+			const uint8_t *desc = usbd_dev->config_descs[descr_idx];
+
+			/* Sent in place, without a copy to ctrl_buf */
+			usbd_dev->control_state.ctrl_const_buf = desc;
+			*len = MIN(*len, desc[2] | (desc[3] << 8));
+			return USBD_REQ_HANDLED;
+		}
 		*buf = usbd_dev->ctrl_buf;
 		*len = build_config_descriptor(usbd_dev, descr_idx, *buf, *len);
 		return USBD_REQ_HANDLED;
@@ -0,0 +1,215 @@
+/** @defgroup usb_transfer_file Generic USB Endpoint Transfers
+
+@ingroup USB
+
+@brief <b>Generic USB Endpoint Transfers</b>
+
+Transfers move a buffer of arbitrary length over a non-control endpoint and
+report back once, when the whole buffer has been sent or received. Drivers
+that can program multi-packet transfers into the hardware do so, all other
+drivers are refilled packet by packet from the endpoint callback.
+
+LGPL License Terms @ref lgpl_license
+*/
+
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**@{*/
+
+#include <stdlib.h>
+#include <libopencm3/usb/usbd.h>
+#include "usb_private.h"
+
+/* Private transfer state bits */
+#define TRANSFER_ZLP_DONE	(1 << 7)
+
+static void usb_transfer_done(usbd_device *usbd_dev, uint8_t ep,
+			      enum _usbd_transaction dir)
+{
+	struct usbd_transfer *xfer = usbd_dev->transfer[ep][dir];
+
+	usbd_dev->user_callback_ctr[ep][dir] = xfer->ep_callback;
+	usbd_dev->transfer[ep][dir] = NULL;
+
+	if (dir == USB_TRANSACTION_IN) {
+		xfer->actual = xfer->queued;
+	}
+
+	if (xfer->complete) {
+		xfer->complete(usbd_dev, xfer);
+	}
+}
+
+/*
+ * Hand as many packets as the driver accepts to an IN endpoint, followed by
+ * a zero-length packet if the transfer needs one.
+ */
+static void usb_transfer_in_fill(usbd_device *usbd_dev, uint8_t ep,
+				 struct usbd_transfer *xfer)
+{
+	uint16_t size = usbd_dev->ep_size[ep][USB_TRANSACTION_IN];
+	uint8_t *buf = xfer->buf;
+
+	while (xfer->queued < xfer->len) {
+		uint16_t len = MIN(size, xfer->len - xfer->queued);
+
+		if (!usbd_ep_write_packet(usbd_dev, 0x80 | ep,
+					  buf + xfer->queued, len)) {
+			return;
+		}
+		xfer->queued += len;
+		xfer->inflight++;
+	}
+
+	/*
+	 * A zero-length packet can not be told apart from a busy endpoint by
+	 * its return value, so only send it once the endpoint is idle.
+	 */
+	if ((xfer->inflight == 0) && !(xfer->state & TRANSFER_ZLP_DONE) &&
+	    ((xfer->len == 0) || ((xfer->flags & USBD_TRANSFER_ZLP) &&
+				  ((xfer->len % size) == 0)))) {
+		usbd_ep_write_packet(usbd_dev, 0x80 | ep, NULL, 0);
+		xfer->state |= TRANSFER_ZLP_DONE;
+		xfer->inflight++;
+	}
+}
+
+static void usb_transfer_in(usbd_device *usbd_dev, uint8_t ep)
+{
+	struct usbd_transfer *xfer = usbd_dev->transfer[ep][USB_TRANSACTION_IN];
+
+	if (xfer->inflight) {
+		xfer->inflight--;
+	}
+
+	usb_transfer_in_fill(usbd_dev, ep, xfer);
+
+	if (xfer->inflight == 0) {
+		usb_transfer_done(usbd_dev, ep, USB_TRANSACTION_IN);
+	}
+}
+
+static void usb_transfer_out(usbd_device *usbd_dev, uint8_t ep)
+{
+	struct usbd_transfer *xfer =
+		usbd_dev->transfer[ep][USB_TRANSACTION_OUT];
+	uint16_t size = usbd_dev->ep_size[ep][USB_TRANSACTION_OUT];
+	uint8_t *buf = xfer->buf;
+	uint16_t len;
+
+	len = usbd_ep_read_packet(usbd_dev, ep, buf + xfer->actual,
+				  MIN(size, xfer->len - xfer->actual));
+	xfer->actual += len;
+
+	/* A short packet ends the transfer early. */
+	if ((len < size) || (xfer->actual >= xfer->len)) {
+		usb_transfer_done(usbd_dev, ep, USB_TRANSACTION_OUT);
+	}
+}
+
+/**
+ * Start a multi-packet transfer on a non-control endpoint.
+ *
+ * IN transfers send xfer->len bytes from xfer->buf, split into packets of the
+ * endpoint's maximum packet size. A transfer of zero bytes sends a single
+ * zero-length packet, and with @ref USBD_TRANSFER_ZLP set a transfer that is
+ * a multiple of the packet size is terminated by one.
+ *
+ * OUT transfers receive into xfer->buf until xfer->len bytes have arrived or
+ * the host sends a short packet. xfer->len should be a multiple of the packet
+ * size, as the tail of a packet that does not fit is dropped.
+ *
+ * While the transfer is in progress, the endpoint callback passed to
+ * usbd_ep_setup() is not called. Once it has finished, xfer->actual holds the
+ * number of bytes transferred and xfer->complete is invoked, from which the
+ * next transfer may be started.
+ *
+ * @param usbd_dev USB device handle
+ * @param addr Endpoint address, including the direction bit
+ * @param xfer Transfer descriptor, which must stay valid until completion
+ * @return Zero on success, -1 if the endpoint is busy or is endpoint 0
+ */
+int usbd_ep_transfer(usbd_device *usbd_dev, uint8_t addr,
+		     struct usbd_transfer *xfer)
+{
+	uint8_t ep = addr & 0x7f;
+	enum _usbd_transaction dir = (addr & 0x80) ?
+				     USB_TRANSACTION_IN : USB_TRANSACTION_OUT;
+
+	if ((ep == 0) || usbd_dev->transfer[ep][dir]) {
+		return -1;
+	}
+
+	xfer->actual = 0;
+	xfer->queued = 0;
+	xfer->inflight = 0;
+	xfer->state = 0;
+	xfer->ep_callback = usbd_dev->user_callback_ctr[ep][dir];
+
+	usbd_dev->transfer[ep][dir] = xfer;
+
+	if (dir == USB_TRANSACTION_OUT) {
+		usbd_dev->user_callback_ctr[ep][dir] = usb_transfer_out;
+		return 0;
+	}
+
+	usbd_dev->user_callback_ctr[ep][dir] = usb_transfer_in;
+
+	if (usbd_dev->driver->ep_transfer_in && xfer->len) {
+		int ret = usbd_dev->driver->ep_transfer_in(usbd_dev, ep, xfer);
+
+		if (ret < 0) {
+			goto busy;
+		}
+		if (ret == 0) {
+			xfer->inflight = 1;
+			return 0;
+		}
+	}
+
+	usb_transfer_in_fill(usbd_dev, ep, xfer);
+	if (xfer->inflight == 0) {
+		goto busy;
+	}
+
+	return 0;
+
+busy:
+	usbd_dev->user_callback_ctr[ep][dir] = xfer->ep_callback;
+	usbd_dev->transfer[ep][dir] = NULL;
+	return -1;
+}
+
+/* Do not appear to belong to the API, so are omitted from docs */
+/**@}*/
+
+void _usbd_transfer_reset(usbd_device *usbd_dev)
+{
+	int i, j;
+
+	/* Drop all transfers, their completion callbacks are not called. */
+	for (i = 0; i < 8; i++) {
+		for (j = 0; j < 2; j++) {
+			if (usbd_dev->transfer[i][j]) {
+				usbd_dev->user_callback_ctr[i][j] =
+					usbd_dev->transfer[i][j]->ep_callback;
+				usbd_dev->transfer[i][j] = NULL;
+			}
+		}
+	}
+}
@@ -0,0 +1,69 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* USB helpers shared by the host programs. */
+
+#include <libopencm3/usb/loopback.h>
+
+#include "bench.h"
+
+/*
+ * Walk the device through the requests a host sends on enumeration, up to
+ * SET_CONFIGURATION. Returns -1 if one of them fails.
+ */
+int bench_enumerate(usbd_device *usbd_dev, uint8_t config)
+{
+	struct usb_setup_data req;
+	uint8_t buf[256];
+
+	req.bmRequestType = USB_REQ_TYPE_IN;
+	req.bRequest = USB_REQ_GET_DESCRIPTOR;
+	req.wValue = USB_DT_DEVICE << 8;
+	req.wIndex = 0;
+	req.wLength = USB_DT_DEVICE_SIZE;
+	if (usb_loopback_control(usbd_dev, &req, buf) != USB_DT_DEVICE_SIZE) {
+		return -1;
+	}
+
+	req.bmRequestType = 0;
+	req.bRequest = USB_REQ_SET_ADDRESS;
+	req.wValue = 5;
+	req.wLength = 0;
+	if ((usb_loopback_control(usbd_dev, &req, NULL) < 0) ||
+	    (usb_loopback_get_address(usbd_dev) != 5)) {
+		return -1;
+	}
+
+	req.bmRequestType = USB_REQ_TYPE_IN;
+	req.bRequest = USB_REQ_GET_DESCRIPTOR;
+	req.wValue = USB_DT_CONFIGURATION << 8;
+	req.wLength = sizeof(buf);
+	if (usb_loopback_control(usbd_dev, &req, buf) <
+	    USB_DT_CONFIGURATION_SIZE) {
+		return -1;
+	}
+
+	req.bmRequestType = 0;
+	req.bRequest = USB_REQ_SET_CONFIGURATION;
+	req.wValue = config;
+	req.wLength = 0;
+	if (usb_loopback_control(usbd_dev, &req, NULL) < 0) {
+		return -1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,276 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Runs the buffered CDC-ACM function against the loopback driver, with an
+ * application that echoes everything it receives. The host model sends a
+ * start of frame, then up to FRAME_PACKETS bulk packets each way per 1 ms
+ * frame, the most a full speed bus carries; the application runs once per
+ * frame. Reports the resulting throughput at full speed, the host CPU time
+ * it took, and how often the host was NAKed. Exits non-zero if data is lost
+ * or class requests reach the wrong interface.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libopencm3/usb/usbd.h>
+#include <libopencm3/usb/cdc.h>
+#include <libopencm3/usb/loopback.h>
+
+#include "bench.h"
+
+#define FRAMES		100000
+#define FRAME_PACKETS	19
+#define EP_OUT		0x01
+#define EP_IN		0x82
+#define EP_NOTIFY	0x83
+
+static const struct usb_device_descriptor dev_desc = {
+	.bLength = USB_DT_DEVICE_SIZE,
+	.bDescriptorType = USB_DT_DEVICE,
+	.bcdUSB = 0x0200,
+	.bDeviceClass = USB_CLASS_CDC,
+	.bMaxPacketSize0 = 64,
+	.idVendor = 0x0483,
+	.idProduct = 0x5740,
+	.bcdDevice = 0x0200,
+	.bNumConfigurations = 1,
+};
+
+static const struct usb_endpoint_descriptor comm_endp[] = {{
+	.bLength = USB_DT_ENDPOINT_SIZE,
+	.bDescriptorType = USB_DT_ENDPOINT,
+	.bEndpointAddress = EP_NOTIFY,
+	.bmAttributes = USB_ENDPOINT_ATTR_INTERRUPT,
+	.wMaxPacketSize = 16,
+	.bInterval = 255,
+} };
+
+static const struct usb_endpoint_descriptor data_endp[] = {{
+	.bLength = USB_DT_ENDPOINT_SIZE,
+	.bDescriptorType = USB_DT_ENDPOINT,
+	.bEndpointAddress = EP_OUT,
+	.bmAttributes = USB_ENDPOINT_ATTR_BULK,
+	.wMaxPacketSize = 64,
+}, {
+	.bLength = USB_DT_ENDPOINT_SIZE,
+	.bDescriptorType = USB_DT_ENDPOINT,
+	.bEndpointAddress = EP_IN,
+	.bmAttributes = USB_ENDPOINT_ATTR_BULK,
+	.wMaxPacketSize = 64,
+} };
+
+static const struct {
+	struct usb_cdc_header_descriptor header;
+	struct usb_cdc_call_management_descriptor call_mgmt;
+	struct usb_cdc_acm_descriptor acm;
+	struct usb_cdc_union_descriptor cdc_union;
+} __attribute__((packed)) cdcacm_functional_descriptors = {
+	.header = {
+		.bFunctionLength = sizeof(struct usb_cdc_header_descriptor),
+		.bDescriptorType = CS_INTERFACE,
+		.bDescriptorSubtype = USB_CDC_TYPE_HEADER,
+		.bcdCDC = 0x0110,
+	},
+	.call_mgmt = {
+		.bFunctionLength =
+			sizeof(struct usb_cdc_call_management_descriptor),
+		.bDescriptorType = CS_INTERFACE,
+		.bDescriptorSubtype = USB_CDC_TYPE_CALL_MANAGEMENT,
+		.bmCapabilities = 0,
+		.bDataInterface = 1,
+	},
+	.acm = {
+		.bFunctionLength = sizeof(struct usb_cdc_acm_descriptor),
+		.bDescriptorType = CS_INTERFACE,
+		.bDescriptorSubtype = USB_CDC_TYPE_ACM,
+		.bmCapabilities = 0,
+	},
+	.cdc_union = {
+		.bFunctionLength = sizeof(struct usb_cdc_union_descriptor),
+		.bDescriptorType = CS_INTERFACE,
+		.bDescriptorSubtype = USB_CDC_TYPE_UNION,
+		.bControlInterface = 0,
+		.bSubordinateInterface0 = 1,
+	},
+};
+
+static const struct usb_interface_descriptor comm_iface = {
+	.bLength = USB_DT_INTERFACE_SIZE,
+	.bDescriptorType = USB_DT_INTERFACE,
+	.bInterfaceNumber = 0,
+	.bNumEndpoints = 1,
+	.bInterfaceClass = USB_CLASS_CDC,
+	.bInterfaceSubClass = USB_CDC_SUBCLASS_ACM,
+	.bInterfaceProtocol = USB_CDC_PROTOCOL_AT,
+	.endpoint = comm_endp,
+	.extra = &cdcacm_functional_descriptors,
+	.extralen = sizeof(cdcacm_functional_descriptors),
+};
+
+static const struct usb_interface_descriptor data_iface = {
+	.bLength = USB_DT_INTERFACE_SIZE,
+	.bDescriptorType = USB_DT_INTERFACE,
+	.bInterfaceNumber = 1,
+	.bNumEndpoints = 2,
+	.bInterfaceClass = USB_CLASS_DATA,
+	.endpoint = data_endp,
+};
+
+static const struct usb_interface ifaces[] = {{
+	.num_altsetting = 1,
+	.altsetting = &comm_iface,
+}, {
+	.num_altsetting = 1,
+	.altsetting = &data_iface,
+} };
+
+static const struct usb_config_descriptor config = {
+	.bLength = USB_DT_CONFIGURATION_SIZE,
+	.bDescriptorType = USB_DT_CONFIGURATION,
+	.bNumInterfaces = 2,
+	.bConfigurationValue = 1,
+	.bmAttributes = 0x80,
+	.bMaxPower = 0x32,
+	.interface = ifaces,
+};
+
+static const char *strings[] = {
+	"libopencm3",
+	"cdcacm bench",
+};
+
+static uint8_t ctrl_buf[128];
+static uint8_t tx_buf[2048];
+static uint8_t rx_buf[2048];
+
+/* Send SET_LINE_CODING to an interface, returns the loopback result. */
+static int set_line_coding(usbd_device *usbd_dev, uint16_t iface,
+			   uint32_t rate)
+{
+	struct usb_cdc_line_coding coding = {
+		.dwDTERate = rate,
+		.bCharFormat = USB_CDC_1_STOP_BITS,
+		.bParityType = USB_CDC_NO_PARITY,
+		.bDataBits = 8,
+	};
+	struct usb_setup_data req = {
+		.bmRequestType = USB_REQ_TYPE_CLASS | USB_REQ_TYPE_INTERFACE,
+		.bRequest = USB_CDC_REQ_SET_LINE_CODING,
+		.wIndex = iface,
+		.wLength = sizeof(coding),
+	};
+
+	return usb_loopback_control(usbd_dev, &req, &coding);
+}
+
+int main(void)
+{
+	struct usb_loopback_stats *stats;
+	usbd_device *usbd_dev;
+	usbd_cdcacm *acm;
+	uint8_t out[64], in[64], app[256];
+	uint32_t sent = 0, echoed = 0, out_nak = 0, in_nak = 0;
+	uint32_t frame, i, j;
+	uint64_t start, elapsed;
+	uint16_t len;
+	int ret;
+
+	usbd_dev = usbd_init(&loopback_usb_driver, &dev_desc, &config,
+			     strings, 2, ctrl_buf, sizeof(ctrl_buf));
+	acm = usb_cdcacm_init(usbd_dev, 0, EP_IN, EP_OUT, 64,
+			      tx_buf, sizeof(tx_buf), rx_buf, sizeof(rx_buf));
+	usbd_poll(usbd_dev);
+
+	if (bench_enumerate(usbd_dev, 1) < 0) {
+		fprintf(stderr, "enumeration failed\n");
+		return 1;
+	}
+
+	if (set_line_coding(usbd_dev, 0, 921600) < 0 ||
+	    usb_cdcacm_get_line_coding(acm)->dwDTERate != 921600) {
+		fprintf(stderr, "line coding not taken\n");
+		return 1;
+	}
+	if (set_line_coding(usbd_dev, 1, 9600) != USB_LOOPBACK_STALL ||
+	    usb_cdcacm_get_line_coding(acm)->dwDTERate != 921600) {
+		fprintf(stderr, "line coding to the data interface taken\n");
+		return 1;
+	}
+
+	stats = usb_loopback_get_stats(usbd_dev);
+
+	start = bench_now_ns();
+	for (frame = 0; frame < FRAMES; frame++) {
+		usb_loopback_sof(usbd_dev);
+		usbd_poll(usbd_dev);
+
+		for (i = 0; i < FRAME_PACKETS; i++) {
+			ret = usb_loopback_in(usbd_dev, EP_IN & 0x7f, in,
+					      sizeof(in));
+			if (ret == USB_LOOPBACK_NAK) {
+				in_nak++;
+			}
+			for (j = 0; (int)j < ret; j++, echoed++) {
+				if (in[j] != (uint8_t)(echoed * 7)) {
+					fprintf(stderr, "corrupt at %u\n",
+						echoed);
+					return 1;
+				}
+			}
+
+			for (j = 0; j < sizeof(out); j++) {
+				out[j] = (uint8_t)((sent + j) * 7);
+			}
+			ret = usb_loopback_out(usbd_dev, EP_OUT, out,
+					       sizeof(out));
+			if (ret == USB_LOOPBACK_NAK) {
+				out_nak++;
+			} else {
+				sent += ret;
+			}
+			usbd_poll(usbd_dev);
+		}
+
+		/* The application's main loop, once per frame */
+		while (usb_cdcacm_tx_free(acm) >= sizeof(app)) {
+			len = usb_cdcacm_read(acm, app, sizeof(app));
+			if (len == 0) {
+				break;
+			}
+			usb_cdcacm_write(acm, app, len);
+		}
+	}
+	elapsed = bench_now_ns() - start;
+
+	if (echoed == 0 || sent - echoed > sizeof(tx_buf) + sizeof(rx_buf) +
+	    2 * 64) {
+		fprintf(stderr, "sent %u, echoed %u\n", sent, echoed);
+		return 1;
+	}
+
+	printf("cdcacm echo:  %8.2f kB/s each way at full speed\n",
+	       echoed / (FRAMES / 1000.0) / 1000.0);
+	printf("host cpu:     %8.2f ms per MB\n",
+	       elapsed / 1e6 / (echoed / 1e6));
+	printf("naks:         %8.2f OUT, %.2f IN per frame, %u SOFs\n",
+	       (double)out_nak / FRAMES, (double)in_nak / FRAMES,
+	       stats->sof);
+
+	return 0;
+}
@@ -0,0 +1,278 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Checks the SPSC and MPMC rings of libopencm3/cm3/ring.h, single threaded
+ * at the edges and with real producer and consumer threads, and reports
+ * their cost per operation. Exits non-zero on the first failure.
+ */
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libopencm3/cm3/ring.h>
+
+#include "bench.h"
+
+#define SPSC_SIZE	1024
+#define SPSC_BYTES	(64 * 1024 * 1024)
+#define MPMC_SIZE	256
+#define MPMC_THREADS	4
+#define MPMC_WORDS	1000000
+#define BENCH_OPS	10000000
+
+#define CHECK(cond) do {						\
+	if (!(cond)) {							\
+		fprintf(stderr, "%s:%d: %s failed\n",			\
+			__FILE__, __LINE__, #cond);			\
+		exit(1);						\
+	}								\
+} while (0)
+
+static uint8_t spsc_buf[SPSC_SIZE];
+static struct ring_spsc spsc;
+static struct ring_mpmc_slot mpmc_slots[MPMC_SIZE];
+static struct ring_mpmc mpmc;
+static uint64_t mpmc_sums[MPMC_THREADS];
+
+static void test_spsc_edges(void)
+{
+	uint8_t in[SPSC_SIZE + 1], out[SPSC_SIZE + 1];
+	uint32_t i;
+	uint8_t c;
+
+	for (i = 0; i < sizeof(in); i++) {
+		in[i] = i * 7;
+	}
+
+	ring_spsc_init(&spsc, spsc_buf, SPSC_SIZE);
+	CHECK(ring_spsc_used(&spsc) == 0);
+	CHECK(ring_spsc_free(&spsc) == SPSC_SIZE);
+	CHECK(!ring_spsc_get(&spsc, &c));
+
+	/* Filling stops at the size. */
+	CHECK(ring_spsc_write(&spsc, in, sizeof(in)) == SPSC_SIZE);
+	CHECK(!ring_spsc_put(&spsc, 0));
+	CHECK(ring_spsc_read(&spsc, out, sizeof(out)) == SPSC_SIZE);
+	CHECK(memcmp(in, out, SPSC_SIZE) == 0);
+
+	/* Data wrapping around the end comes out in order. */
+	for (i = 0; i < 3 * SPSC_SIZE; i += 100) {
+		CHECK(ring_spsc_write(&spsc, in, 300) == 300);
+		CHECK(ring_spsc_read(&spsc, out, 300) == 300);
+		CHECK(memcmp(in, out, 300) == 0);
+	}
+
+	/* The free running indices wrap at 2^32 too. */
+	spsc.head = spsc.tail = 0xfffffff0;
+	CHECK(ring_spsc_write(&spsc, in, 100) == 100);
+	CHECK(ring_spsc_used(&spsc) == 100);
+	CHECK(ring_spsc_read(&spsc, out, 100) == 100);
+	CHECK(memcmp(in, out, 100) == 0);
+	CHECK(ring_spsc_put(&spsc, 42) && ring_spsc_get(&spsc, &c) && c == 42);
+
+	/* Peeking leaves the data in place until skipped. */
+	CHECK(ring_spsc_write(&spsc, in, 10) == 10);
+	CHECK(ring_spsc_peek(&spsc, out, 4) == 4);
+	CHECK(ring_spsc_used(&spsc) == 10);
+	ring_spsc_skip(&spsc, 4);
+	CHECK(ring_spsc_read(&spsc, out + 4, sizeof(out)) == 6);
+	CHECK(memcmp(in, out, 10) == 0);
+}
+
+static void test_mpmc_edges(void)
+{
+	uint32_t i, val;
+
+	ring_mpmc_init(&mpmc, mpmc_slots, MPMC_SIZE);
+	CHECK(!ring_mpmc_pop(&mpmc, &val));
+
+	for (i = 0; i < MPMC_SIZE; i++) {
+		CHECK(ring_mpmc_push(&mpmc, i));
+	}
+	CHECK(!ring_mpmc_push(&mpmc, i));
+
+	for (i = 0; i < MPMC_SIZE; i++) {
+		CHECK(ring_mpmc_pop(&mpmc, &val) && val == i);
+	}
+	CHECK(!ring_mpmc_pop(&mpmc, &val));
+
+	/* Reuse of the slots over several laps */
+	for (i = 0; i < 10 * MPMC_SIZE; i++) {
+		CHECK(ring_mpmc_push(&mpmc, i));
+		CHECK(ring_mpmc_pop(&mpmc, &val) && val == i);
+	}
+}
+
+static void *spsc_producer(void *arg)
+{
+	uint8_t chunk[97];
+	uint32_t sent = 0, i, n;
+
+	(void)arg;
+
+	while (sent < SPSC_BYTES) {
+		n = sizeof(chunk);
+		if (n > SPSC_BYTES - sent) {
+			n = SPSC_BYTES - sent;
+		}
+		for (i = 0; i < n; i++) {
+			chunk[i] = (uint8_t)(sent + i);
+		}
+		n = ring_spsc_write(&spsc, chunk, n);
+		if (n == 0) {
+			sched_yield();
+		}
+		sent += n;
+	}
+
+	return NULL;
+}
+
+static void test_spsc_threads(void)
+{
+	pthread_t producer;
+	uint8_t chunk[61];
+	uint32_t got = 0, i, n;
+	uint64_t start, elapsed;
+
+	ring_spsc_init(&spsc, spsc_buf, SPSC_SIZE);
+
+	start = bench_now_ns();
+	CHECK(pthread_create(&producer, NULL, spsc_producer, NULL) == 0);
+	while (got < SPSC_BYTES) {
+		n = ring_spsc_read(&spsc, chunk, sizeof(chunk));
+		if (n == 0) {
+			sched_yield();
+		}
+		for (i = 0; i < n; i++) {
+			CHECK(chunk[i] == (uint8_t)(got + i));
+		}
+		got += n;
+	}
+	pthread_join(producer, NULL);
+	elapsed = bench_now_ns() - start;
+
+	printf("spsc threads: %8.2f MB/s\n", SPSC_BYTES * 1000.0 / elapsed);
+}
+
+static void *mpmc_producer(void *arg)
+{
+	uint32_t id = (uintptr_t)arg;
+	uint32_t i;
+
+	for (i = 1; i <= MPMC_WORDS; i++) {
+		while (!ring_mpmc_push(&mpmc, (id << 24) | (i & 0xffffff))) {
+			sched_yield();
+		}
+	}
+
+	return NULL;
+}
+
+static void *mpmc_consumer(void *arg)
+{
+	uint32_t id = (uintptr_t)arg;
+	uint32_t last[MPMC_THREADS] = { 0 };
+	uint32_t i, val, p;
+
+	for (i = 0; i < MPMC_WORDS; i++) {
+		while (!ring_mpmc_pop(&mpmc, &val)) {
+			sched_yield();
+		}
+		/* Each producer's words reach a consumer in order. */
+		p = val >> 24;
+		CHECK(p < MPMC_THREADS);
+		CHECK((val & 0xffffff) > last[p]);
+		last[p] = val & 0xffffff;
+		mpmc_sums[id] += val;
+	}
+
+	return NULL;
+}
+
+static void test_mpmc_threads(void)
+{
+	pthread_t producers[MPMC_THREADS], consumers[MPMC_THREADS];
+	uint64_t start, elapsed, sum = 0, expect = 0;
+	uintptr_t i;
+
+	ring_mpmc_init(&mpmc, mpmc_slots, MPMC_SIZE);
+
+	start = bench_now_ns();
+	for (i = 0; i < MPMC_THREADS; i++) {
+		CHECK(pthread_create(&consumers[i], NULL, mpmc_consumer,
+				     (void *)i) == 0);
+		CHECK(pthread_create(&producers[i], NULL, mpmc_producer,
+				     (void *)i) == 0);
+	}
+	for (i = 0; i < MPMC_THREADS; i++) {
+		pthread_join(producers[i], NULL);
+		pthread_join(consumers[i], NULL);
+	}
+	elapsed = bench_now_ns() - start;
+
+	/* Every word was popped exactly once. */
+	for (i = 0; i < MPMC_THREADS; i++) {
+		sum += mpmc_sums[i];
+		expect += ((uint64_t)i << 24) * MPMC_WORDS +
+			  (uint64_t)MPMC_WORDS * (MPMC_WORDS + 1) / 2;
+	}
+	CHECK(sum == expect);
+
+	printf("mpmc threads: %8.2f Mwords/s, %d producers and consumers\n",
+	       (double)MPMC_THREADS * MPMC_WORDS * 1000.0 / elapsed,
+	       MPMC_THREADS);
+}
+
+static void bench_single(void)
+{
+	uint64_t start, elapsed;
+	uint32_t i, val;
+	uint8_t c;
+
+	ring_spsc_init(&spsc, spsc_buf, SPSC_SIZE);
+	start = bench_now_ns();
+	for (i = 0; i < BENCH_OPS; i++) {
+		ring_spsc_put(&spsc, (uint8_t)i);
+		ring_spsc_get(&spsc, &c);
+	}
+	elapsed = bench_now_ns() - start;
+	printf("spsc put+get: %8.2f ns\n", (double)elapsed / BENCH_OPS);
+
+	ring_mpmc_init(&mpmc, mpmc_slots, MPMC_SIZE);
+	start = bench_now_ns();
+	for (i = 0; i < BENCH_OPS; i++) {
+		ring_mpmc_push(&mpmc, i);
+		ring_mpmc_pop(&mpmc, &val);
+	}
+	elapsed = bench_now_ns() - start;
+	printf("mpmc push+pop: %7.2f ns\n", (double)elapsed / BENCH_OPS);
+}
+
+int main(void)
+{
+	test_spsc_edges();
+	test_mpmc_edges();
+	test_spsc_threads();
+	test_mpmc_threads();
+	bench_single();
+
+	return 0;
+}
@@ -0,0 +1,169 @@
+/*
+ * This file is part of the libopencm3 project.
+ *
+ * This library is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Runs the USB stack against the loopback driver: enumerates a device with
+ * a bulk echo interface, then pushes packets through it. Reports the time
+ * per enumeration, the bulk throughput and the endpoint callbacks run per
+ * packet. Exits non-zero if the device misbehaves.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <libopencm3/usb/usbd.h>
+#include <libopencm3/usb/loopback.h>
+
+#include "bench.h"
+
+#define ENUM_ROUNDS	10000
+#define BULK_PACKETS	1000000
+#define EP_OUT		0x01
+#define EP_IN		0x82
+
+static const struct usb_device_descriptor dev_desc = {
+	.bLength = USB_DT_DEVICE_SIZE,
+	.bDescriptorType = USB_DT_DEVICE,
+	.bcdUSB = 0x0200,
+	.bMaxPacketSize0 = 64,
+	.idVendor = 0x0483,
+	.idProduct = 0x5740,
+	.bcdDevice = 0x0200,
+	.bNumConfigurations = 1,
+};
+
+static const struct usb_endpoint_descriptor echo_endp[] = {{
+	.bLength = USB_DT_ENDPOINT_SIZE,
+	.bDescriptorType = USB_DT_ENDPOINT,
+	.bEndpointAddress = EP_OUT,
+	.bmAttributes = USB_ENDPOINT_ATTR_BULK,
+	.wMaxPacketSize = 64,
+}, {
+	.bLength = USB_DT_ENDPOINT_SIZE,
+	.bDescriptorType = USB_DT_ENDPOINT,
+	.bEndpointAddress = EP_IN,
+	.bmAttributes = USB_ENDPOINT_ATTR_BULK,
+	.wMaxPacketSize = 64,
+} };
+
+static const struct usb_interface_descriptor echo_iface = {
+	.bLength = USB_DT_INTERFACE_SIZE,
+	.bDescriptorType = USB_DT_INTERFACE,
+	.bNumEndpoints = 2,
+	.bInterfaceClass = 0xff,
+	.endpoint = echo_endp,
+};
+
+static const struct usb_interface ifaces[] = {{
+	.num_altsetting = 1,
+	.altsetting = &echo_iface,
+} };
+
+static const struct usb_config_descriptor config = {
+	.bLength = USB_DT_CONFIGURATION_SIZE,
+	.bDescriptorType = USB_DT_CONFIGURATION,
+	.bNumInterfaces = 1,
+	.bConfigurationValue = 1,
+	.bmAttributes = 0x80,
+	.bMaxPower = 0x32,
+	.interface = ifaces,
+};
+
+static const char *strings[] = {
+	"libopencm3",
+	"loopback bench",
+};
+
+static uint8_t ctrl_buf[128];
+
+static void echo_rx_cb(usbd_device *usbd_dev, uint8_t ep)
+{
+	uint8_t buf[64];
+	uint16_t len = usbd_ep_read_packet(usbd_dev, ep, buf, sizeof(buf));
+
+	usbd_ep_write_packet(usbd_dev, EP_IN, buf, len);
+}
+
+static void echo_set_config(usbd_device *usbd_dev, uint16_t wValue)
+{
+	(void)wValue;
+
+	usbd_ep_setup(usbd_dev, EP_OUT, USB_ENDPOINT_ATTR_BULK, 64,
+		      echo_rx_cb);
+	usbd_ep_setup(usbd_dev, EP_IN, USB_ENDPOINT_ATTR_BULK, 64, NULL);
+}
+
+static usbd_device *enumerate(void)
+{
+	usbd_device *usbd_dev;
+
+	usbd_dev = usbd_init(&loopback_usb_driver, &dev_desc, &config,
+			     strings, 2, ctrl_buf, sizeof(ctrl_buf));
+	usbd_register_set_config_callback(usbd_dev, echo_set_config);
+	usbd_poll(usbd_dev);
+
+	if (bench_enumerate(usbd_dev, 1) < 0) {
+		fprintf(stderr, "enumeration failed\n");
+		exit(1);
+	}
+
+	return usbd_dev;
+}
+
+int main(void)
+{
+	struct usb_loopback_stats *stats;
+	usbd_device *usbd_dev = NULL;
+	uint8_t out[64], in[64];
+	uint64_t start, elapsed;
+	uint32_t i, callbacks;
+	int ret;
+
+	start = bench_now_ns();
+	for (i = 0; i < ENUM_ROUNDS; i++) {
+		usbd_dev = enumerate();
+	}
+	elapsed = bench_now_ns() - start;
+	printf("enumeration:  %8.2f us\n",
+	       elapsed / 1000.0 / ENUM_ROUNDS);
+
+	stats = usb_loopback_get_stats(usbd_dev);
+	callbacks = stats->callbacks;
+
+	start = bench_now_ns();
+	for (i = 0; i < BULK_PACKETS; i++) {
+		memset(out, (uint8_t)i, sizeof(out));
+		ret = usb_loopback_out(usbd_dev, EP_OUT, out, sizeof(out));
+		usbd_poll(usbd_dev);
+		if (ret == sizeof(out)) {
+			ret = usb_loopback_in(usbd_dev, EP_IN & 0x7f, in,
+					      sizeof(in));
+		}
+		if ((ret != sizeof(in)) || memcmp(in, out, sizeof(in))) {
+			fprintf(stderr, "echo failed at packet %u\n", i);
+			return 1;
+		}
+	}
+	elapsed = bench_now_ns() - start;
+	printf("bulk echo:    %8.2f MB/s each way\n",
+	       BULK_PACKETS * 64.0 * 1000.0 / elapsed);
+	printf("callbacks:    %8.2f per packet\n",
+	       (double)(stats->callbacks - callbacks) / BULK_PACKETS);
+
+	return 0;
+}